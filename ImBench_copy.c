@@ -0,0 +1,86 @@
+/*
+ * Benchmark: frame copy paths
+ *
+ * compile with:
+ * gcc -O2 ImBench_copy.c ImageStreamIO.c -lm -lpthread
+ *
+ * Required files in compilation directory :
+ * ImBench_copy.c    : source code (this file)
+ * ImageStreamIO.c   : ImageStreamIO source code
+ * ImageStreamIO.h   : ImageCreate function prototypes
+ * ImageStruct.h     : Image structure definition
+ *
+ * EXECUTION:
+ * ./a.out [maxsizeMB]
+ * (default: 64 MB)
+ *
+ * Copies frames from 64 kB up to maxsizeMB with each copy path supported
+ * by the CPU (memcpy, SSE2 / AVX2 / AVX-512 non-temporal stores, and the
+ * automatic selection used by the library), and reports GB/s.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ImageStreamIO.h"
+
+int main(int argc, char **argv)
+{
+    size_t maxsize = ((argc > 1) ? atol(argv[1]) : 64) * 1024 * 1024;
+
+    uint8_t *src = (uint8_t *)malloc(maxsize);
+    uint8_t *dst = (uint8_t *)malloc(maxsize);
+    if ((src == NULL) || (dst == NULL))
+    {
+        printf("cannot allocate %lu bytes\n", (unsigned long)maxsize);
+        return EXIT_FAILURE;
+    }
+    memset(src, 1, maxsize);
+    memset(dst, 0, maxsize);
+
+    printf("%10s", "size [kB]");
+    for (int path = IMAGE_COPY_AUTO; path <= IMAGE_COPY_AVX512_NT; path++)
+    {
+        printf(" %10s", ImageStreamIO_copy_pathname(path));
+    }
+    printf("   [GB/s]\n");
+
+    for (size_t size = 64 * 1024; size <= maxsize; size *= 4)
+    {
+        // about 1 GB copied per measurement
+        long NBiter = (1L << 30) / size;
+        if (NBiter < 4)
+        {
+            NBiter = 4;
+        }
+
+        printf("%10lu", (unsigned long)(size / 1024));
+        for (int path = IMAGE_COPY_AUTO; path <= IMAGE_COPY_AVX512_NT; path++)
+        {
+            if (ImageStreamIO_copy_path(dst, src, size, path) != IMAGESTREAMIO_SUCCESS)
+            {
+                printf(" %10s", "-");
+                continue;
+            }
+
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (long iter = 0; iter < NBiter; iter++)
+            {
+                ImageStreamIO_copy_path(dst, src, size, path);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+
+            double dt = (t1.tv_sec - t0.tv_sec) + 1.0e-9 * (t1.tv_nsec - t0.tv_nsec);
+            printf(" %10.2f", 1.0e-9 * size * NBiter / dt);
+        }
+        printf("\n");
+    }
+
+    free(src);
+    free(dst);
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Benchmark: one writer, several readers on different cores
+ *
+ * compile with:
+ * gcc -O2 ImBench_readers.c ImageStreamIO.c -lm -lpthread
+ *
+ * Required files in compilation directory :
+ * ImBench_readers.c : source code (this file)
+ * ImageStreamIO.c   : ImageStreamIO source code
+ * ImageStreamIO.h   : ImageCreate function prototypes
+ * ImageStruct.h     : Image structure definition
+ *
+ * EXECUTION:
+ * ./a.out [NBreader] [NBframe]
+ * (default: 10 readers, 100000 frames)
+ *
+ * Creates a small futex stream imbench00 in shared memory.
+ * The writer runs on CPU 0 and publishes frames back-to-back,
+ * reader i runs on CPU i+1 and waits on semaphore i.
+ * Each reader has its own handle on the stream, as a separate
+ * process would.
+ *
+ * Reports writer frame rate, and per reader the frames seen and
+ * mean / max latency between writetime and wake-up.
+ * Compare with a build of a previous IMAGESTRUCT_VERSION to see the
+ * effect of the metadata / semaphore cache line layout.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "ImageStreamIO.h"
+
+#define BENCH_STREAMNAME "imbench00"
+
+typedef struct
+{
+    int index;               // reader index = semaphore index = CPU - 1
+    volatile int *stop;
+    uint64_t nbframe;        // frames seen
+    double latsum;           // sum of latencies [s]
+    double latmax;           // max latency [s]
+} BENCH_READER;
+
+static void bench_pincpu(int cpu)
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu % sysconf(_SC_NPROCESSORS_ONLN), &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+}
+
+static double bench_dt(struct timespec t0, struct timespec t1)
+{
+    return (t1.tv_sec - t0.tv_sec) + 1.0e-9 * (t1.tv_nsec - t0.tv_nsec);
+}
+
+static void *bench_reader(void *arg)
+{
+    BENCH_READER *rd = (BENCH_READER *)arg;
+    IMAGE image;
+
+    bench_pincpu(rd->index + 1);
+
+    if (ImageStreamIO_openIm(&image, BENCH_STREAMNAME) != IMAGESTREAMIO_SUCCESS)
+    {
+        return NULL;
+    }
+
+    while (!*rd->stop)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 10000000; // 10 ms, to notice stop
+        if (ts.tv_nsec >= 1000000000)
+        {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+
+        if (ImageStreamIO_semtimedwait(&image, rd->index, &ts) == 0)
+        {
+            struct timespec tnow;
+            clock_gettime(CLOCK_REALTIME, &tnow);
+            double lat = bench_dt(image.md->writetime, tnow);
+
+            rd->nbframe++;
+            rd->latsum += lat;
+            if (lat > rd->latmax)
+            {
+                rd->latmax = lat;
+            }
+        }
+    }
+
+    ImageStreamIO_closeIm(&image);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int NBreader = (argc > 1) ? atoi(argv[1]) : 10;
+    long NBframe = (argc > 2) ? atol(argv[2]) : 100000;
+
+    IMAGE image;
+    uint32_t imsize[2] = { 64, 64 };
+    volatile int stop = 0;
+
+    if (ImageStreamIO_createIm_gpu(&image, BENCH_STREAMNAME, 2, imsize,
+                                   _DATATYPE_FLOAT, -1, 1, NBreader, 0,
+                                   MATH_DATA | IMAGE_OPT_FUTEX, 0) != IMAGESTREAMIO_SUCCESS)
+    {
+        printf("cannot create stream %s\n", BENCH_STREAMNAME);
+        return EXIT_FAILURE;
+    }
+
+    pthread_t *thread = (pthread_t *)malloc(sizeof(pthread_t) * NBreader);
+    BENCH_READER *rd = (BENCH_READER *)calloc(NBreader, sizeof(BENCH_READER));
+
+    for (int r = 0; r < NBreader; r++)
+    {
+        rd[r].index = r;
+        rd[r].stop = &stop;
+        pthread_create(&thread[r], NULL, bench_reader, &rd[r]);
+    }
+
+    bench_pincpu(0);
+    usleep(100000); // let readers attach
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_REALTIME, &t0);
+    for (long f = 0; f < NBframe; f++)
+    {
+        ImageStreamIO_BeginUpdateIm(&image);
+        image.array.F[f % image.md->nelement] = (float)f;
+        clock_gettime(CLOCK_REALTIME, &image.md->writetime);
+        ImageStreamIO_UpdateIm(&image);
+    }
+    clock_gettime(CLOCK_REALTIME, &t1);
+
+    usleep(100000); // drain
+    stop = 1;
+    for (int r = 0; r < NBreader; r++)
+    {
+        pthread_join(thread[r], NULL);
+    }
+
+    double dt = bench_dt(t0, t1);
+    printf("IMAGESTRUCT_VERSION %s, %d readers\n", IMAGESTRUCT_VERSION, NBreader);
+    printf("writer: %ld frames in %.3f s, %.0f Hz\n", NBframe, dt, NBframe / dt);
+    for (int r = 0; r < NBreader; r++)
+    {
+        printf("reader %2d: %8lu frames, latency mean %8.2f us, max %8.2f us\n",
+               r, (unsigned long)rd[r].nbframe,
+               rd[r].nbframe ? 1.0e6 * rd[r].latsum / rd[r].nbframe : 0.0,
+               1.0e6 * rd[r].latmax);
+    }
+
+    free(rd);
+    free(thread);
+    ImageStreamIO_destroyIm(&image);
+
+    return 0;
+}
@@ -65,7 +65,8 @@ int main()
 	NBkw = 3;
 
 	// create an image in shared memory
-	ImageStreamIO_createIm_gpu(&imarray, "imtest00", naxis, imsize, atype, -1, shared, 10, NBkw, 2);
+	ImageStreamIO_createIm_gpu(&imarray, "imtest00", naxis, imsize, atype, -1, shared, 10, NBkw,
+	                           CIRCULAR_BUFFER | ZAXIS_TEMPORAL, 0);
 
     strncpy(imarray.kw[0].name, "symcode", KEYWORD_MAX_STRING-1);
     imarray.kw[0].type = 'L';
@@ -97,7 +98,6 @@ int main()
 
 	int s;
 	int semval;
-	unsigned int index;
 	float *current_image;
 
 	// writes a square in image
@@ -113,16 +113,10 @@ int main()
 		yc = y0 + r*sin(angle);
 
 
-		imarray.md->write = 1; // set this flag to 1 when writing data
+		ImageStreamIO_BeginUpdateIm(&imarray); // set write flag when writing data
 
-		index = imarray.md->cnt1 +1;
-		if(index == imarray.md->size[2])
-			index=0;
-
-		current_image = imarray.array.F + index * imarray.md->size[0] * imarray.md->size[1];
-       // printf("%lu %lu %lu %x\r", imarray.md->cnt0, imarray.md->cnt1, index,
-		// 				current_image);
-       // printf("%d, %x \n", index * imarray.md->size[0] * imarray.md->size[1], current_image);
+		// next slice of the circular buffer
+		ImageStreamIO_writeBuffer(&imarray, (void **) &current_image);
 		for(ii=0; ii<imarray.md->size[0]; ii++)
 			for(jj=0; jj<imarray.md->size[1]; jj++)
 			{
@@ -137,14 +131,10 @@ int main()
 				//else
 				//	imarray.array.F[jj*imarray.md->size[0]+ii] = 0.0;
 			}
-		imarray.md->cnt1 = index;
-		imarray.md->cnt0++;
 		clock_gettime(CLOCK_ISIO, &imarray.md[0].lastaccesstime);
 
-		// POST ALL SEMAPHORES
-		ImageStreamIO_sempost(&imarray, -1);
-
-		imarray.md->write = 0; // Done writing data
+		// publish slice: cnt1, cnt0, slice times and counter, then post all semaphores
+		ImageStreamIO_commitSlice(&imarray, NULL);
 
 		usleep(dtus);
 		angle += dangle;
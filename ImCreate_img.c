@@ -104,7 +104,7 @@ int main()
         yc = y0 + r*sin(angle);
 
 
-        imarray.md->write = 1; // set this flag to 1 when writing data
+        ImageStreamIO_BeginUpdateIm(&imarray); // set write flag when writing data
 
         for(ii=0; ii<imarray.md->size[0]; ii++)
             for(jj=0; jj<imarray.md->size[1]; jj++)
@@ -121,11 +121,8 @@ int main()
                 //	imarray.array.F[jj*imarray.md->size[0]+ii] = 0.0;
             }
         imarray.md->cnt1 = 0;
-        imarray.md->cnt0++;
-        // POST ALL SEMAPHORES
-        ImageStreamIO_sempost(&imarray, -1);
-
-        imarray.md->write = 0; // Done writing data
+        // INCREMENT cnt0, CLEAR WRITE FLAG AND POST ALL SEMAPHORES
+        ImageStreamIO_UpdateIm(&imarray);
 
         usleep(dtus);
         angle += dangle;
@@ -22,19 +22,30 @@
 #include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <linux/futex.h>
+
 #include <dirent.h>
+#include <limits.h>
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h> // for open
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <unistd.h> // for close
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 #ifdef USE_CFITSIO
 #include <fitsio.h>
 #endif
@@ -72,9 +83,11 @@ void __attribute__((constructor)) libinit_ImageStreamIO()
     }
 }
 
+static void ImageStreamIO_copy_init(void);
+
 errno_t init_ImageStreamIO()
 {
-    // any initialization needed ?
+    ImageStreamIO_copy_init();
 
     return IMAGESTREAMIO_SUCCESS;
 }
@@ -274,6 +287,557 @@ errno_t ImageStreamIO_readBufferAt(
 
 
 
+// Frame copy engine
+// Frames larger than a fraction of the last level cache are copied with
+// non-temporal (streaming) stores: the destination (circular buffer,
+// reader copy) is not read back by the copying process, and regular
+// stores would evict its working set. Widest streaming path supported by
+// the CPU is selected at library load.
+
+#define IMAGESTREAMIO_COPY_DEFAULTLLC (8UL * 1024 * 1024)
+
+static int ImageStreamIO_copy_ntpath = IMAGE_COPY_MEMCPY; // widest streaming path supported
+static size_t ImageStreamIO_copy_ntminsize = IMAGESTREAMIO_COPY_DEFAULTLLC / 2;
+
+#if defined(__x86_64__)
+// copy up to dst alignment, so that streaming stores are aligned
+static inline size_t ImageStreamIO_copy_head(
+    uint8_t **dst,
+    const uint8_t **src,
+    size_t n,
+    size_t align)
+{
+    size_t head = (align - ((uintptr_t)*dst & (align - 1))) & (align - 1);
+    if (head > n)
+    {
+        head = n;
+    }
+    memcpy(*dst, *src, head);
+    *dst += head;
+    *src += head;
+    return n - head;
+}
+
+__attribute__((target("sse2")))
+static void ImageStreamIO_copy_sse2nt(
+    void *dst,
+    const void *src,
+    size_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+
+    n = ImageStreamIO_copy_head(&d, &s, n, 16);
+    for (; n >= 64; n -= 64, d += 64, s += 64)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)s);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_stream_si128((__m128i *)d, v0);
+        _mm_stream_si128((__m128i *)(d + 16), v1);
+        _mm_stream_si128((__m128i *)(d + 32), v2);
+        _mm_stream_si128((__m128i *)(d + 48), v3);
+    }
+    memcpy(d, s, n);
+    // streaming stores are weakly ordered, complete them before publishing
+    _mm_sfence();
+}
+
+__attribute__((target("avx2")))
+static void ImageStreamIO_copy_avx2nt(
+    void *dst,
+    const void *src,
+    size_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+
+    n = ImageStreamIO_copy_head(&d, &s, n, 32);
+    for (; n >= 128; n -= 128, d += 128, s += 128)
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)s);
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+        __m256i v2 = _mm256_loadu_si256((const __m256i *)(s + 64));
+        __m256i v3 = _mm256_loadu_si256((const __m256i *)(s + 96));
+        _mm256_stream_si256((__m256i *)d, v0);
+        _mm256_stream_si256((__m256i *)(d + 32), v1);
+        _mm256_stream_si256((__m256i *)(d + 64), v2);
+        _mm256_stream_si256((__m256i *)(d + 96), v3);
+    }
+    memcpy(d, s, n);
+    _mm_sfence();
+}
+
+__attribute__((target("avx512f")))
+static void ImageStreamIO_copy_avx512nt(
+    void *dst,
+    const void *src,
+    size_t n)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+
+    n = ImageStreamIO_copy_head(&d, &s, n, 64);
+    for (; n >= 256; n -= 256, d += 256, s += 256)
+    {
+        __m512i v0 = _mm512_loadu_si512((const void *)s);
+        __m512i v1 = _mm512_loadu_si512((const void *)(s + 64));
+        __m512i v2 = _mm512_loadu_si512((const void *)(s + 128));
+        __m512i v3 = _mm512_loadu_si512((const void *)(s + 192));
+        _mm512_stream_si512((void *)d, v0);
+        _mm512_stream_si512((void *)(d + 64), v1);
+        _mm512_stream_si512((void *)(d + 128), v2);
+        _mm512_stream_si512((void *)(d + 192), v3);
+    }
+    memcpy(d, s, n);
+    _mm_sfence();
+}
+#endif
+
+static int ImageStreamIO_copy_supported(
+    int path)
+{
+    switch (path)
+    {
+    case IMAGE_COPY_AUTO:
+    case IMAGE_COPY_MEMCPY:
+        return 1;
+#if defined(__x86_64__)
+    case IMAGE_COPY_SSE2_NT:
+        return 1;
+    case IMAGE_COPY_AVX2_NT:
+        return __builtin_cpu_supports("avx2");
+    case IMAGE_COPY_AVX512_NT:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return 0;
+    }
+}
+
+static void ImageStreamIO_copy_init(void)
+{
+    // non-temporal stores pay off once a frame does not fit in half the LLC
+    long llcsize = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llcsize <= 0)
+    {
+        llcsize = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+    if (llcsize <= 0)
+    {
+        llcsize = IMAGESTREAMIO_COPY_DEFAULTLLC;
+    }
+    ImageStreamIO_copy_ntminsize = llcsize / 2;
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+#endif
+    for (int path = IMAGE_COPY_AVX512_NT; path > IMAGE_COPY_MEMCPY; path--)
+    {
+        if (ImageStreamIO_copy_supported(path))
+        {
+            ImageStreamIO_copy_ntpath = path;
+            break;
+        }
+    }
+}
+
+static void ImageStreamIO_copy_dispatch(
+    void *dst,
+    const void *src,
+    size_t n,
+    int path)
+{
+    switch (path)
+    {
+#if defined(__x86_64__)
+    case IMAGE_COPY_SSE2_NT:
+        ImageStreamIO_copy_sse2nt(dst, src, n);
+        break;
+    case IMAGE_COPY_AVX2_NT:
+        ImageStreamIO_copy_avx2nt(dst, src, n);
+        break;
+    case IMAGE_COPY_AVX512_NT:
+        ImageStreamIO_copy_avx512nt(dst, src, n);
+        break;
+#endif
+    default:
+        memcpy(dst, src, n);
+        break;
+    }
+}
+
+void *ImageStreamIO_copy(
+    void *dst,
+    const void *src,
+    size_t n)
+{
+    ImageStreamIO_copy_dispatch(dst, src, n,
+                                (n >= ImageStreamIO_copy_ntminsize) ?
+                                ImageStreamIO_copy_ntpath : IMAGE_COPY_MEMCPY);
+    return dst;
+}
+
+errno_t ImageStreamIO_copy_path(
+    void *dst,
+    const void *src,
+    size_t n,
+    int path)
+{
+    if (!ImageStreamIO_copy_supported(path))
+    {
+        return IMAGESTREAMIO_NOTIMPL;
+    }
+
+    if (path == IMAGE_COPY_AUTO)
+    {
+        ImageStreamIO_copy(dst, src, n);
+    }
+    else
+    {
+        ImageStreamIO_copy_dispatch(dst, src, n, path);
+    }
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+const char *ImageStreamIO_copy_pathname(
+    int path)
+{
+    switch (path)
+    {
+    case IMAGE_COPY_AUTO:
+        return "auto";
+    case IMAGE_COPY_MEMCPY:
+        return "memcpy";
+    case IMAGE_COPY_SSE2_NT:
+        return "sse2-nt";
+    case IMAGE_COPY_AVX2_NT:
+        return "avx2-nt";
+    case IMAGE_COPY_AVX512_NT:
+        return "avx512-nt";
+    default:
+        return "unknown";
+    }
+}
+
+
+
+// Copy worker pool
+// Opt-in per stream with ImageStreamIO_set_copythreads: frames of at
+// least image->copyminsize bytes are split between the caller and
+// image->copythreads - 1 persistent workers. Workers are pinned
+// round-robin to online NUMA nodes, starting with the node after the first
+// one, so that each memory controller serves part of the copy. The pool is
+// created on first use and shared by all streams of the process, one copy
+// at a time. A forked child does not inherit the workers, it starts its own.
+
+#define IMAGESTREAMIO_COPYPOOL_MAXTHREAD 64
+
+typedef struct
+{
+    pthread_mutex_t lock;   // held by the thread running a pooled copy
+    pid_t    pid;           // process that started the workers
+    int      nbworker;      // workers started
+    uint32_t gen;           // job generation, workers wait on it
+    uint32_t remaining;     // workers yet to acknowledge job, caller waits on it
+    uint32_t startgen[IMAGESTREAMIO_COPYPOOL_MAXTHREAD]; // gen when worker was started
+    int      jobnbpart;     // parts in current job, part 0 is copied by the caller
+    uint8_t *dst;
+    const uint8_t *src;
+    size_t   n;
+    size_t   chunk;
+    int      path;
+} IMAGESTREAMIO_COPYPOOL;
+
+static IMAGESTREAMIO_COPYPOOL ImageStreamIO_copypool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void ImageStreamIO_copypool_futexwait(
+    uint32_t *addr,
+    uint32_t value)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void ImageStreamIO_copypool_futexwake(
+    uint32_t *addr,
+    int nwake)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nwake, NULL, NULL, 0);
+}
+
+// Read /sys list file (format: 0-15,32-47) into values, in increasing order
+// Returns number of values, 0 if file not found
+static int ImageStreamIO_sysfs_list(
+    const char *fname,
+    int *values,
+    int maxvalues)
+{
+    FILE *fp = fopen(fname, "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    int nbvalue = 0;
+    int v0, v1;
+    char sep;
+    while (fscanf(fp, "%d", &v0) == 1)
+    {
+        v1 = v0;
+        sep = (char)fgetc(fp);
+        if (sep == '-')
+        {
+            if (fscanf(fp, "%d", &v1) != 1)
+            {
+                break;
+            }
+            sep = (char)fgetc(fp);
+        }
+        for (int v = v0; (v <= v1) && (nbvalue < maxvalues); v++)
+        {
+            values[nbvalue++] = v;
+        }
+        if (sep != ',')
+        {
+            break;
+        }
+    }
+    fclose(fp);
+
+    return nbvalue;
+}
+
+// CPUs of NUMA node from /sys, returns 0 if node not found
+static int ImageStreamIO_numa_cpuset(
+    int node,
+    cpu_set_t *cpuset)
+{
+    char fname[STRINGMAXLEN_FILE_NAME];
+    snprintf(fname, sizeof(fname), "/sys/devices/system/node/node%d/cpulist", node);
+
+    int cpus[CPU_SETSIZE];
+    int nbcpu = ImageStreamIO_sysfs_list(fname, cpus, CPU_SETSIZE);
+
+    CPU_ZERO(cpuset);
+    for (int i = 0; i < nbcpu; i++)
+    {
+        CPU_SET(cpus[i], cpuset);
+    }
+
+    return CPU_COUNT(cpuset) > 0;
+}
+
+#define IMAGESTREAMIO_NUMA_MAXNODE 256 // see IMAGE_OPT_NUMANODE
+
+static int ImageStreamIO_numa_nodeid[IMAGESTREAMIO_NUMA_MAXNODE];
+
+// Number of online NUMA nodes. Node IDs may be sparse (offline or
+// memoryless nodes), the i-th online node is ImageStreamIO_numa_nodeid[i].
+static int ImageStreamIO_numa_nbnode(void)
+{
+    static int nbnode = -1;
+    if (nbnode < 0)
+    {
+        nbnode = ImageStreamIO_sysfs_list("/sys/devices/system/node/online",
+                                          ImageStreamIO_numa_nodeid,
+                                          IMAGESTREAMIO_NUMA_MAXNODE);
+    }
+    return nbnode;
+}
+
+static void ImageStreamIO_copypool_part(
+    IMAGESTREAMIO_COPYPOOL *pool,
+    int part)
+{
+    size_t offset = pool->chunk * part;
+    if (offset < pool->n)
+    {
+        size_t n = pool->n - offset;
+        if (n > pool->chunk)
+        {
+            n = pool->chunk;
+        }
+        ImageStreamIO_copy_dispatch(pool->dst + offset, pool->src + offset, n, pool->path);
+    }
+}
+
+static void *ImageStreamIO_copypool_worker(
+    void *arg)
+{
+    IMAGESTREAMIO_COPYPOOL *pool = &ImageStreamIO_copypool;
+    int index = (int)(intptr_t)arg;
+    uint32_t gen = pool->startgen[index];
+
+    int nbnode = ImageStreamIO_numa_nbnode();
+    cpu_set_t cpuset;
+    if ((nbnode > 1) &&
+            ImageStreamIO_numa_cpuset(ImageStreamIO_numa_nodeid[(index + 1) % nbnode], &cpuset))
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    }
+
+    for (;;)
+    {
+        uint32_t newgen;
+        while ((newgen = __atomic_load_n(&pool->gen, __ATOMIC_ACQUIRE)) == gen)
+        {
+            ImageStreamIO_copypool_futexwait(&pool->gen, gen);
+        }
+        gen = newgen;
+
+        // all workers acknowledge each job, those beyond jobnbpart copy nothing
+        if (index + 1 < pool->jobnbpart)
+        {
+            ImageStreamIO_copypool_part(pool, index + 1);
+        }
+        if (__atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_ACQ_REL) == 0)
+        {
+            ImageStreamIO_copypool_futexwake(&pool->remaining, 1);
+        }
+    }
+    return NULL;
+}
+
+// frame copy with IMAGE_COPY_XXX path, split across copy pool if enabled
+static void *ImageStreamIO_copyframe_path(
+    const IMAGE *image,
+    void *dst,
+    const void *src,
+    size_t n,
+    int path)
+{
+    IMAGESTREAMIO_COPYPOOL *pool = &ImageStreamIO_copypool;
+    int nbthread = image->copythreads;
+
+    if ((nbthread <= 1) || (n < image->copyminsize) ||
+            (pthread_mutex_trylock(&pool->lock) != 0))
+    {
+        // not enabled, small frame, or pool busy with another copy
+        ImageStreamIO_copy_dispatch(dst, src, n, path);
+        return dst;
+    }
+
+    pid_t pid = getpid();
+    if (pool->pid != pid)
+    {
+        // first use, or forked child: the parent's workers do not exist here
+        pool->pid = pid;
+        pool->nbworker = 0;
+    }
+
+    while (pool->nbworker < nbthread - 1)
+    {
+        pthread_t thread;
+        int index = pool->nbworker;
+
+        pool->startgen[index] = pool->gen;
+        if (pthread_create(&thread, NULL, ImageStreamIO_copypool_worker,
+                           (void *)(intptr_t)index) != 0)
+        {
+            break;
+        }
+        pthread_detach(thread);
+        pool->nbworker++;
+    }
+
+    int nbpart = (pool->nbworker + 1 < nbthread) ? pool->nbworker + 1 : nbthread;
+
+    pool->dst = (uint8_t *)dst;
+    pool->src = (const uint8_t *)src;
+    pool->n = n;
+    // parts start on cache lines
+    pool->chunk = ((n + nbpart - 1) / nbpart + IMAGE_CACHELINE_SIZE - 1) &
+                  ~(size_t)(IMAGE_CACHELINE_SIZE - 1);
+    pool->path = path;
+    pool->jobnbpart = nbpart;
+    __atomic_store_n(&pool->remaining, pool->nbworker, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&pool->gen, 1, __ATOMIC_RELEASE);
+    ImageStreamIO_copypool_futexwake(&pool->gen, INT_MAX);
+
+    ImageStreamIO_copypool_part(pool, 0);
+
+    uint32_t remaining;
+    while ((remaining = __atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE)) != 0)
+    {
+        ImageStreamIO_copypool_futexwait(&pool->remaining, remaining);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return dst;
+}
+
+void *ImageStreamIO_copyframe(
+    const IMAGE *image,
+    void *dst,
+    const void *src,
+    size_t n)
+{
+    return ImageStreamIO_copyframe_path(image, dst, src, n,
+                                        (n >= ImageStreamIO_copy_ntminsize) ?
+                                        ImageStreamIO_copy_ntpath : IMAGE_COPY_MEMCPY);
+}
+
+void *ImageStreamIO_copyframe_cached(
+    const IMAGE *image,
+    void *dst,
+    const void *src,
+    size_t n)
+{
+    return ImageStreamIO_copyframe_path(image, dst, src, n, IMAGE_COPY_MEMCPY);
+}
+
+errno_t ImageStreamIO_numa_pin(
+    const IMAGE *image)
+{
+    cpu_set_t cpuset;
+
+    if ((image->md->numapolicy != IMAGE_NUMA_BIND) ||
+            !ImageStreamIO_numa_cpuset(image->md->numanode, &cpuset))
+    {
+        errno = ENOENT;
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0)
+    {
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+errno_t ImageStreamIO_set_copythreads(
+    IMAGE *image,
+    int nbthread,
+    size_t minsize)
+{
+    if ((nbthread < 0) || (nbthread > IMAGESTREAMIO_COPYPOOL_MAXTHREAD))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG, "invalid number of copy threads");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    if (nbthread == 0)
+    {
+        // one part per NUMA node, at least two
+        nbthread = ImageStreamIO_numa_nbnode();
+        if (nbthread < 2)
+        {
+            nbthread = 2;
+        }
+    }
+
+    image->copythreads = nbthread;
+    image->copyminsize = (minsize > 0) ? minsize : IMAGE_COPYPOOL_MINSIZE;
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+
+
 errno_t ImageStreamIO_shmdirname(
     char *shmdname)
 {
@@ -362,6 +926,8 @@ int ImageStreamIO_typesize(
     case _DATATYPE_DOUBLE:        return SIZEOF_DATATYPE_DOUBLE;
     case _DATATYPE_COMPLEX_FLOAT: return SIZEOF_DATATYPE_COMPLEX_FLOAT;
     case _DATATYPE_COMPLEX_DOUBLE:return SIZEOF_DATATYPE_COMPLEX_DOUBLE;
+    case _DATATYPE_EVENT_UI8_UI8_UI16_UI8:
+        return SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8;
     default:                      break;
     }
     ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG, "invalid type code");
@@ -386,6 +952,7 @@ const char *ImageStreamIO_typename(
     case _DATATYPE_DOUBLE:         return "FLT64";
     case _DATATYPE_COMPLEX_FLOAT:  return "CPLX32";
     case _DATATYPE_COMPLEX_DOUBLE: return "CPLX64";
+    case _DATATYPE_EVENT_UI8_UI8_UI16_UI8: return "EVENT";
     default:                       break;
     }
     return "unknown";
@@ -409,6 +976,7 @@ const char *ImageStreamIO_typename_7(
     case _DATATYPE_DOUBLE:         return "DOUBLE ";
     case _DATATYPE_COMPLEX_FLOAT:  return "CFLOAT ";
     case _DATATYPE_COMPLEX_DOUBLE: return "CDOUBLE";
+    case _DATATYPE_EVENT_UI8_UI8_UI16_UI8: return "EVENT  ";
     default:                       break;
     }
     return "unknown";
@@ -456,6 +1024,7 @@ const char *ImageStreamIO_typename_short(
     case _DATATYPE_DOUBLE:         return " DBL";
     case _DATATYPE_COMPLEX_FLOAT:  return "CFLT";
     case _DATATYPE_COMPLEX_DOUBLE: return "CDBL";
+    case _DATATYPE_EVENT_UI8_UI8_UI16_UI8: return " EVT";
     default:                       break;
     }
     return " ???";
@@ -549,6 +1118,12 @@ uint64_t ImageStreamIO_offset_data(
         image->array.raw = ImageStreamIO_get_image_d_ptr(image);
         offset = 0;
     }
+    else if (image->md->imagetype & IMAGE_OPT_CBZEROCOPY)
+    {
+        // no data array, array.raw is set to a CB slot once CB is mapped
+        image->array.raw = map;
+        offset = 0;
+    }
     else
     {
         image->array.raw = map;
@@ -636,49 +1211,444 @@ uint64_t ImageStreamIO_initialize_buffer(
 /* ===============================================================================================
  */
 
-errno_t ImageStreamIO_createIm(
-    IMAGE *image,
-    const char *name,
-    long naxis,
-    uint32_t *size,
-    uint8_t datatype,
-    int shared,
-    int NBkw,
-    int CBsize)
+// stream registry updates, see section 3
+static void ImageStreamIO_registry_add(const IMAGE *image);
+static void ImageStreamIO_registry_remove(const char *name, ino_t inode);
+
+// uncached open, see ImageStreamIO_openIm_flags
+static errno_t ImageStreamIO_openIm_map(IMAGE *image, const char *name, int flags);
+
+// open cache entry removal on destroy, see ImageStreamIO_openIm_flags
+static int ImageStreamIO_opencache_evict(const IMAGE *image, sem_t **semlog);
+
+// Huge pages (IMAGE_OPT_HUGEPAGE)
+// On a hugetlbfs shm directory the stream file is backed by huge pages.
+// Elsewhere (tmpfs) transparent huge pages are requested with madvise,
+// effective if /sys/kernel/mm/transparent_hugepage/shmem_enabled allows it.
+// Either way, data array and circular buffer data are aligned to the huge
+// page size, recorded in md->hugepagesize.
+
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC 0x958458f6
+#endif
+
+#define IMAGESTREAMIO_THP_DEFAULTSIZE (2UL * 1024 * 1024)
+
+static inline uint64_t ImageStreamIO_alignup(
+    uint64_t size,
+    uint64_t align)
 {
-    return ImageStreamIO_createIm_gpu(image, name, naxis, size, datatype, -1,
-                                      shared, IMAGE_NB_SEMAPHORE, NBkw,
-                                      MATH_DATA, (uint32_t)CBsize);
+    return (align > 0) ? ((size + align - 1) / align) * align : size;
 }
 
+// Shared stream arrays each start on a cache line, so that arrays written by
+// readers (semReadPID, semstatus, semreader) and by the writer (semWritePID)
+// do not share lines. Reader slots (semreader) have one line per index.
 
+// end offset of array of arraysize bytes placed on the first cache line after offset
+static inline size_t ImageStreamIO_arrayend(
+    size_t offset,
+    size_t arraysize)
+{
+    return ImageStreamIO_alignup(offset, IMAGE_CACHELINE_SIZE) + arraysize;
+}
 
-errno_t ImageStreamIO_createIm_gpu(
-    IMAGE *image,
-    const char *name,
-    long naxis,
-    uint32_t *size,
-    uint8_t datatype,
-    int8_t location, // -1: CPU RAM, 0+ : GPU
-    int shared,
-    int NBsem,
-    int NBkw,
-    uint64_t imagetype,
-    uint32_t CBsize // circular buffer size (if shared), 0 if not used
-)
+static inline uint8_t *ImageStreamIO_cachealign(
+    uint8_t *map)
 {
-    long nelement;
+    return (uint8_t *)ImageStreamIO_alignup((uintptr_t)map, IMAGE_CACHELINE_SIZE);
+}
 
-    uint8_t *map;
+// frame data of circular buffer slot
+static inline void *ImageStreamIO_CBslotptr(
+    const IMAGE *image,
+    uint32_t CBslot)
+{
+    return (uint8_t *)image->CBimdata + image->md->imdatamemsize * CBslot;
+}
 
-    int kw;
+// CB slot stamp protocol: CircBuff_md[slot].cnt0 is 0 while the slot is
+// (re)written, and the frame cnt0 once the frame is published
 
-    // Get shm directory name (only on first call to this function)
-    static char shmdirname[200];
-    static int initSHAREDMEMDIR = 0;
-    if (initSHAREDMEMDIR == 0)
-    {
-        ImageStreamIO_shmdirname(shmdirname);
+static inline void ImageStreamIO_CBslot_invalidate(
+    IMAGE *image,
+    uint32_t CBslot)
+{
+    __atomic_store_n(&image->CircBuff_md[CBslot].cnt0, 0, __ATOMIC_RELAXED);
+    // order before frame data stores
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void ImageStreamIO_CBslot_stamp(
+    IMAGE *image,
+    uint32_t CBslot,
+    uint64_t cnt0)
+{
+    CBFRAMEMD *framemd = &image->CircBuff_md[CBslot];
+
+    framemd->cnt1 = image->md->cnt1;
+    framemd->atime = image->md->atime;
+    clock_gettime(CLOCK_ISIO, &framemd->writetime);
+    __atomic_store_n(&framemd->cnt0, cnt0, __ATOMIC_RELEASE);
+}
+
+// huge page size for stream name, sets *hugetlbfs if shm directory is on hugetlbfs
+static uint64_t ImageStreamIO_hugepagesize(
+    const char *name,
+    int *hugetlbfs)
+{
+    char fname[STRINGMAXLEN_FILE_NAME];
+    struct statfs fsstat;
+
+    *hugetlbfs = 0;
+    ImageStreamIO_filename(fname, sizeof(fname), name);
+    char *dirsep = strrchr(fname, '/');
+    if (dirsep != NULL)
+    {
+        *dirsep = '\0';
+    }
+    if ((statfs(fname, &fsstat) == 0) && (fsstat.f_type == HUGETLBFS_MAGIC))
+    {
+        *hugetlbfs = 1;
+        return fsstat.f_bsize;
+    }
+
+    // transparent huge pages are PMD-sized
+    uint64_t hugepagesize = IMAGESTREAMIO_THP_DEFAULTSIZE;
+    FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+    if (fp != NULL)
+    {
+        unsigned long pmdsize;
+        if ((fscanf(fp, "%lu", &pmdsize) == 1) && (pmdsize > 0))
+        {
+            hugepagesize = pmdsize;
+        }
+        fclose(fp);
+    }
+    return hugepagesize;
+}
+
+// request transparent huge pages for a stream mapping, unless on hugetlbfs
+static void ImageStreamIO_madvise_hugepage(
+    int fd,
+    void *map,
+    size_t size)
+{
+    struct statfs fsstat;
+    if ((fstatfs(fd, &fsstat) == 0) && (fsstat.f_type == HUGETLBFS_MAGIC))
+    {
+        return;
+    }
+    // not an error if THP is unavailable
+    madvise(map, size, MADV_HUGEPAGE);
+}
+
+// NUMA placement (IMAGE_OPT_NUMABIND, IMAGE_OPT_NUMAINTERLEAVE)
+// Policy is set with mbind right after the stream is mapped, before data
+// pages are touched. On tmpfs / hugetlbfs it is a shared policy kept by
+// the file, so pages first touched by any process follow it.
+
+#ifndef MPOL_BIND
+#define MPOL_BIND       2
+#define MPOL_INTERLEAVE 3
+#endif
+
+// apply IMAGE_NUMA_XXX policy to [offset, offset + size) of map, widened to whole pages
+static int ImageStreamIO_numa_mbind(
+    uint8_t *map,
+    size_t offset,
+    size_t size,
+    size_t pagesize,
+    uint8_t numapolicy,
+    int numanode)
+{
+    unsigned long nodemask[4] = { 0 }; // nodes 0-255, see IMAGE_OPT_NUMANODE
+    const int maskbits = 8 * sizeof(unsigned long);
+    int mode;
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    if (numapolicy == IMAGE_NUMA_BIND)
+    {
+        mode = MPOL_BIND;
+        nodemask[numanode / maskbits] |= 1UL << (numanode % maskbits);
+    }
+    else
+    {
+        mode = MPOL_INTERLEAVE;
+        int nbnode = ImageStreamIO_numa_nbnode();
+        for (int i = 0; i < nbnode; i++)
+        {
+            int node = ImageStreamIO_numa_nodeid[i];
+            if (node >= IMAGESTREAMIO_NUMA_MAXNODE)
+            {
+                continue;
+            }
+            nodemask[node / maskbits] |= 1UL << (node % maskbits);
+        }
+        if (nbnode == 0)
+        {
+            nodemask[0] = 1UL;
+        }
+    }
+
+    uintptr_t start = ((uintptr_t)map + offset) / pagesize * pagesize;
+    uintptr_t end = ImageStreamIO_alignup((uintptr_t)map + offset + size, pagesize);
+
+    return (int)syscall(SYS_mbind, (void *)start, end - start, mode,
+                        nodemask, sizeof(nodemask) * 8, 0);
+}
+
+// Prepare stream mapping so that first frames do not take page faults.
+// request: IMAGE_MEMSTATUS_XXX bits wanted, populated: mapped with MAP_POPULATE
+// write: touch pages with writes (new stream), reads otherwise
+// Returns IMAGE_MEMSTATUS_XXX bits achieved.
+static uint32_t ImageStreamIO_memprepare(
+    uint8_t *map,
+    size_t size,
+    uint32_t request,
+    int populated,
+    int write)
+{
+    uint32_t status = 0;
+    long pagesize = sysconf(_SC_PAGESIZE);
+
+    if ((request & IMAGE_MEMSTATUS_PRETOUCHED) ||
+            ((request & IMAGE_MEMSTATUS_POPULATED) && !populated))
+    {
+        // first touch allocates pages on this thread's NUMA node
+        for (size_t offset = 0; offset < size; offset += pagesize)
+        {
+            if (write)
+            {
+                // does not change content, even if written concurrently
+                __atomic_fetch_add(map + offset, 0, __ATOMIC_RELAXED);
+            }
+            else
+            {
+                (void)*(volatile uint8_t *)(map + offset);
+            }
+        }
+        status |= request & (IMAGE_MEMSTATUS_PRETOUCHED | IMAGE_MEMSTATUS_POPULATED);
+    }
+    else if (request & IMAGE_MEMSTATUS_POPULATED)
+    {
+        status |= IMAGE_MEMSTATUS_POPULATED;
+    }
+
+    if (request & IMAGE_MEMSTATUS_LOCKED)
+    {
+        if (mlock(map, size) == 0)
+        {
+            status |= IMAGE_MEMSTATUS_LOCKED;
+        }
+        else
+        {
+            char wmsg[200];
+            snprintf(wmsg, sizeof(wmsg), "mlock of %zu bytes failed (%s), stream not locked",
+                     size, strerror(errno));
+            ImageStreamIO_printWARNING(wmsg);
+        }
+    }
+
+    return status;
+}
+
+// IMAGE_MEMSTATUS_XXX bits requested by stream options
+static uint32_t ImageStreamIO_memrequest(
+    uint64_t imagetype)
+{
+    return ((imagetype & IMAGE_OPT_POPULATE) ? IMAGE_MEMSTATUS_POPULATED : 0) |
+           ((imagetype & IMAGE_OPT_MLOCK) ? IMAGE_MEMSTATUS_LOCKED : 0) |
+           ((imagetype & IMAGE_OPT_PRETOUCH) ? IMAGE_MEMSTATUS_PRETOUCHED : 0);
+}
+
+// stream file has IMAGESTRUCT_VERSION metadata, checked without mapping it
+static int ImageStreamIO_versionmatch(
+    const char *fname)
+{
+    char version[32];
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1)
+    {
+        return 0;
+    }
+    ssize_t n = pread(fd, version, sizeof(version), offsetof(IMAGE_METADATA, version));
+    close(fd);
+
+    return (n == (ssize_t)sizeof(version)) &&
+           (strncmp(version, IMAGESTRUCT_VERSION, sizeof(version)) == 0);
+}
+
+// Stream teardown (IMAGE_SEMAPHORE_CONTROL_READY)
+// Before a shared stream is destroyed or replaced, READY is cleared on all
+// semaphores and they are posted, so that waiting readers return and
+// reconnect to the next stream of that name, see ImageStreamIO_reconnect.
+// The file is unlinked rather than truncated: readers keep a valid mapping.
+static void ImageStreamIO_teardown(
+    IMAGE *image)
+{
+    for (int s = 0; s < image->md->sem; s++)
+    {
+        __atomic_fetch_and(&image->semctrl[s], ~IMAGE_SEMAPHORE_CONTROL_READY, __ATOMIC_SEQ_CST);
+    }
+    ImageStreamIO_sempost(image, -1);
+}
+
+// Re-create shared stream in place (IMAGE_OPT_REUSE)
+// If stream name exists with the same layout, it is mapped and its
+// counters are reset: file, data, semaphores and connected readers are
+// kept. Returns IMAGESTREAMIO_FAILURE if there is no compatible stream.
+static errno_t ImageStreamIO_reuseIm(
+    IMAGE *image,
+    const char *name,
+    long naxis,
+    uint32_t *size,
+    uint8_t datatype,
+    int NBsem,
+    int NBkw,
+    uint64_t imagetype,
+    uint32_t CBsize)
+{
+    char SM_fname[STRINGMAXLEN_FILE_NAME];
+    struct stat file_stat;
+
+    ImageStreamIO_filename(SM_fname, sizeof(SM_fname), name);
+    if (stat(SM_fname, &file_stat) != 0)
+    {
+        return IMAGESTREAMIO_FAILURE;
+    }
+    // writer handle, never from the open cache
+    if (ImageStreamIO_openIm_map(image, name, IMAGE_OPEN_LAZYSEM) != IMAGESTREAMIO_SUCCESS)
+    {
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    IMAGE_METADATA *md = image->md;
+    int compatible = (strncmp(md->name, name, STRINGMAXLEN_IMAGE_NAME) == 0) &&
+                     (md->location == -1) &&
+                     (md->datatype == datatype) &&
+                     (md->naxis == naxis) &&
+                     (md->NBkw == NBkw) &&
+                     (md->sem == NBsem) &&
+                     (md->CBsize == CBsize) &&
+                     ((md->imagetype & ~IMAGE_OPT_REUSE) == (imagetype & ~IMAGE_OPT_REUSE));
+    for (long i = 0; compatible && (i < naxis); i++)
+    {
+        compatible = (md->size[i] == size[i]);
+    }
+    if (!compatible)
+    {
+        ImageStreamIO_closeIm(image);
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    md->creatorPID = getpid();
+    md->ownerPID = 0;
+    clock_gettime(CLOCK_ISIO, &md->creationtime);
+    md->lastaccesstime = md->creationtime;
+
+    md->write = 0;
+    md->cnt0 = 0;
+    md->cnt1 = 0;
+    md->cnt2 = 0;
+    md->cnt2next = 0;
+    md->CBindex = 0;
+    md->CBcycle = 0;
+    md->CBticket = 0;
+    md->publishPID = 0;
+    md->slicelostcnt = 0;
+    md->flowdropcnt = 0;
+#ifdef IMAGESTRUCT_WRITEHISTORY
+    md->wCBindex = 0;
+    md->wCBcycle = 0;
+#endif
+
+    if (image->cntarray != NULL)
+    {
+        memset(image->cntarray, 0, sizeof(uint64_t) * md->size[2]);
+    }
+    if (image->eventbatch != NULL)
+    {
+        memset(image->eventbatch, 0, sizeof(IMAGE_EVENTBATCH) * IMAGE_EVENT_NBBATCH);
+    }
+    if (CBsize > 0)
+    {
+        memset(image->CircBuff_md, 0, sizeof(CBFRAMEMD) * CBsize);
+    }
+    if (imagetype & IMAGE_OPT_CBZEROCOPY)
+    {
+        image->array.raw = ImageStreamIO_CBslotptr(image, 1);
+    }
+    // readers keep their indices: frames consumed and posts pending refer
+    // to the previous counters
+    if (image->semreader != NULL)
+    {
+        for (int s = 0; s < NBsem; s++)
+        {
+            __atomic_store_n(&image->semreader[s].cnt0, 0, __ATOMIC_RELAXED);
+        }
+    }
+    ImageStreamIO_semflush(image, -1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    strncpy(image->name, name, STRINGMAXLEN_IMAGE_NAME);
+    image->name[STRINGMAXLEN_IMAGE_NAME-1] = '\0';
+
+    ImageStreamIO_registry_add(image);
+
+    image->used = 1;
+    image->createcnt++;
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+errno_t ImageStreamIO_createIm(
+    IMAGE *image,
+    const char *name,
+    long naxis,
+    uint32_t *size,
+    uint8_t datatype,
+    int shared,
+    int NBkw,
+    int CBsize)
+{
+    return ImageStreamIO_createIm_gpu(image, name, naxis, size, datatype, -1,
+                                      shared, IMAGE_NB_SEMAPHORE, NBkw,
+                                      MATH_DATA, (uint32_t)CBsize);
+}
+
+
+
+errno_t ImageStreamIO_createIm_gpu(
+    IMAGE *image,
+    const char *name,
+    long naxis,
+    uint32_t *size,
+    uint8_t datatype,
+    int8_t location, // -1: CPU RAM, 0+ : GPU
+    int shared,
+    int NBsem,
+    int NBkw,
+    uint64_t imagetype,
+    uint32_t CBsize // circular buffer size (if shared), 0 if not used
+)
+{
+    long nelement;
+
+    uint8_t *map;
+
+    int kw;
+
+    // Get shm directory name (only on first call to this function)
+    static char shmdirname[200];
+    static int initSHAREDMEMDIR = 0;
+    if (initSHAREDMEMDIR == 0)
+    {
+        ImageStreamIO_shmdirname(shmdirname);
         for (unsigned int stri = 0; stri < strlen(shmdirname); stri++)
             if (shmdirname[stri] == '/') // replace '/' by '.'
             {
@@ -696,6 +1666,12 @@ errno_t ImageStreamIO_createIm_gpu(
     }
     uint64_t imdatamemsize = ImageStreamIO_typesize(datatype) * nelement;
 
+    if (imagetype & IMAGE_OPT_BROADCAST)
+    {
+        // broadcast publish relies on futex semaphores
+        imagetype |= IMAGE_OPT_FUTEX;
+    }
+
     if (((imagetype & 0xF000F) == CIRCULAR_BUFFER) &&
             (naxis != 3))
     {
@@ -705,11 +1681,46 @@ errno_t ImageStreamIO_createIm_gpu(
         return IMAGESTREAMIO_INVALIDARG;
     }
 
+    if ((imagetype & IMAGE_OPT_CBZEROCOPY) &&
+            ((shared != 1) || (location != -1) || (CBsize < 2)))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "Error calling ImageStreamIO_createIm_gpu, "
+                                 "IMAGE_OPT_CBZEROCOPY needs shared CPU stream with CBsize >= 2");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    if ((imagetype & IMAGE_OPT_REUSE) && (shared == 1) && (location == -1) &&
+            (ImageStreamIO_reuseIm(image, name, naxis, size, datatype, NBsem, NBkw,
+                                   imagetype, CBsize) == IMAGESTREAMIO_SUCCESS))
+    {
+        return IMAGESTREAMIO_SUCCESS;
+    }
+
     // compute total size to be allocated
     if (shared == 1)
     {
         char semlogname[200];
 
+        if (location == -1)
+        {
+            // replaced stream: release its readers (before its semaphores are
+            // re-created), new stream gets a new file
+            char SM_fname[STRINGMAXLEN_FILE_NAME];
+            IMAGE oldimage;
+
+            ImageStreamIO_filename(SM_fname, sizeof(SM_fname), name);
+            if (ImageStreamIO_versionmatch(SM_fname) &&
+                    (ImageStreamIO_openIm_map(&oldimage, name, IMAGE_OPEN_LAZYSEM) == IMAGESTREAMIO_SUCCESS))
+            {
+                ImageStreamIO_teardown(&oldimage);
+                // as destroyIm: new stream starts with fresh semaphores
+                ImageStreamIO_destroysem(&oldimage);
+                ImageStreamIO_closeIm(&oldimage);
+            }
+            unlink(SM_fname);
+        }
+
         // create semlog
         size_t sharedsize = 0;     // shared memory size in bytes
         size_t datasharedsize = 0; // shared memory size in bytes used by the data
@@ -726,23 +1737,39 @@ errno_t ImageStreamIO_createIm_gpu(
         remove(semlogname);
         image->semlog = NULL;
 
-        umask(0);
-        if ((image->semlog = sem_open(semlogname, O_CREAT, FILEMODE, 1)) == SEM_FAILED)
+        // futex streams keep semlog in the stream, see ImageStreamIO_createsem
+        if (!(imagetype & IMAGE_OPT_FUTEX))
         {
-            fprintf(stderr, "Semaphore log %s :", semlogname);
-            ImageStreamIO_printERROR(IMAGESTREAMIO_SEMINIT,
-                                     "semaphore creation / initialization");
+            umask(0);
+            if ((image->semlog = sem_open(semlogname, O_CREAT, FILEMODE, 1)) == SEM_FAILED)
+            {
+                fprintf(stderr, "Semaphore log %s :", semlogname);
+                ImageStreamIO_printERROR(IMAGESTREAMIO_SEMINIT,
+                                         "semaphore creation / initialization");
+            }
+            else
+            {
+                sem_init(
+                    image->semlog, 1,
+                    SEMAPHORE_INITVAL); // SEMAPHORE_INITVAL defined in ImageStruct.h
+            }
         }
-        else
+        uint64_t hugepagesize = 0;
+        int hugetlbfs = 0;
+        if (imagetype & IMAGE_OPT_HUGEPAGE)
         {
-            sem_init(
-                image->semlog, 1,
-                SEMAPHORE_INITVAL); // SEMAPHORE_INITVAL defined in ImageStruct.h
+            hugepagesize = ImageStreamIO_hugepagesize(name, &hugetlbfs);
         }
-        sharedsize = sizeof(IMAGE_METADATA);
+
+        // data array starts on a huge page boundary
+        sharedsize = ImageStreamIO_alignup(sizeof(IMAGE_METADATA), hugepagesize);
         datasharedsize = imdatamemsize;
 
-        if (location == -1)
+        if (imagetype & IMAGE_OPT_CBZEROCOPY)
+        {
+            // frames live in the circular buffer only
+        }
+        else if (location == -1)
         {
             // image on CPU
             // printf("shared memory space in CPU RAM = %ud bytes\n", sharedsize);
@@ -760,40 +1787,64 @@ errno_t ImageStreamIO_createIm_gpu(
             return IMAGESTREAMIO_FAILURE;
         }
 
-        sharedsize += sizeof(IMAGE_KEYWORD) * NBkw;
+        // each array below starts on its own cache line
 
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(IMAGE_KEYWORD) * NBkw);
 
-        sharedsize += sizeof(SEMFILEDATA) * NBsem;
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(SEMFILEDATA) * NBsem);
 
         // one read PID array, one write PID array
-        sharedsize += 2 * NBsem * sizeof(pid_t);
+        sharedsize = ImageStreamIO_arrayend(sharedsize, NBsem * sizeof(pid_t));
+        sharedsize = ImageStreamIO_arrayend(sharedsize, NBsem * sizeof(pid_t));
 
         // semctrl
-        sharedsize += sizeof(uint32_t) * NBsem;
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(uint32_t) * NBsem);
 
         // semstatus
-        sharedsize += sizeof(uint32_t) * NBsem;
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(uint32_t) * NBsem);
+
+        // futex semaphores, followed by semlog and broadcast generation
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(SEMFUTEX) * (NBsem + 2));
+
+        // reader slots: consumed position and lease
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(SEMREADER) * NBsem);
 
-        sharedsize += sizeof(STREAM_PROC_TRACE) * NBproctrace;
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(STREAM_PROC_TRACE) * NBproctrace);
 
         if ((imagetype & 0xF000F) ==
                 (CIRCULAR_BUFFER | ZAXIS_TEMPORAL)) // Circular buffer
         {
             // room for atimearray, writetimearray and cntarray
-            sharedsize += size[2] * (2 * sizeof(struct timespec) + sizeof(uint64_t));
+            sharedsize = ImageStreamIO_arrayend(sharedsize, size[2] * sizeof(struct timespec));
+            sharedsize = ImageStreamIO_arrayend(sharedsize, size[2] * sizeof(struct timespec));
+            sharedsize = ImageStreamIO_arrayend(sharedsize, size[2] * sizeof(uint64_t));
+        }
+
+        if (datatype == _DATATYPE_EVENT_UI8_UI8_UI16_UI8)
+        {
+            // event batch metadata
+            sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(IMAGE_EVENTBATCH) * IMAGE_EVENT_NBBATCH);
         }
 
         // fast circular buffer metadata
-        sharedsize += sizeof(CBFRAMEMD) * CBsize;
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(CBFRAMEMD) * CBsize);
 
-        // fast circular buffer data buffer
-        sharedsize += datasharedsize * CBsize;
+        // fast circular buffer data buffer, on a huge page boundary
+        if (CBsize > 0)
+        {
+            sharedsize = ImageStreamIO_alignup(sharedsize, hugepagesize);
+        }
+        size_t CBdataoffset = ImageStreamIO_alignup(sharedsize, IMAGE_CACHELINE_SIZE);
+        sharedsize = ImageStreamIO_arrayend(sharedsize, datasharedsize * CBsize);
 
 #ifdef IMAGESTRUCT_WRITEHISTORY
         // write time buffer
-        sharedsize += sizeof(FRAMEWRITEMD) * IMAGESTRUCT_FRAMEWRITEMDSIZE;
+        sharedsize = ImageStreamIO_arrayend(sharedsize, sizeof(FRAMEWRITEMD) * IMAGESTRUCT_FRAMEWRITEMDSIZE);
 #endif
 
+        // whole huge pages (required on hugetlbfs)
+        sharedsize = ImageStreamIO_alignup(sharedsize, hugepagesize);
+
         char SM_fname[200];
         ImageStreamIO_filename(SM_fname, 200, name);
 
@@ -819,25 +1870,59 @@ errno_t ImageStreamIO_createIm_gpu(
         image->memsize = sharedsize;
 
         int result;
-        result = lseek(SM_fd, sharedsize - 1, SEEK_SET);
-        if (result == -1)
+        if (hugetlbfs)
         {
-            close(SM_fd);
-            ImageStreamIO_printERROR(IMAGESTREAMIO_FILESEEK,
-                                     "Error calling lseek() to 'stretch' the file");
-            return IMAGESTREAMIO_FILESEEK;
+            // hugetlbfs files cannot be written, only truncated
+            if (ftruncate(SM_fd, sharedsize) == -1)
+            {
+                close(SM_fd);
+                ImageStreamIO_printERROR(IMAGESTREAMIO_FILEWRITE,
+                                         "Error calling ftruncate() on hugetlbfs file");
+                return IMAGESTREAMIO_FILEWRITE;
+            }
+        }
+        else
+        {
+            result = lseek(SM_fd, sharedsize - 1, SEEK_SET);
+            if (result == -1)
+            {
+                close(SM_fd);
+                ImageStreamIO_printERROR(IMAGESTREAMIO_FILESEEK,
+                                         "Error calling lseek() to 'stretch' the file");
+                return IMAGESTREAMIO_FILESEEK;
+            }
+
+            result = write(SM_fd, "", 1);
+            if (result != 1)
+            {
+                close(SM_fd);
+                ImageStreamIO_printERROR(IMAGESTREAMIO_FILEWRITE,
+                                         "Error writing last byte of the file");
+                return IMAGESTREAMIO_FILEWRITE;
+            }
         }
 
-        result = write(SM_fd, "", 1);
-        if (result != 1)
+        uint8_t numapolicy = IMAGE_NUMA_DEFAULT;
+        int16_t numanode = -1;
+        if ((location == -1) && (imagetype & IMAGE_OPT_NUMABIND))
         {
-            close(SM_fd);
-            ImageStreamIO_printERROR(IMAGESTREAMIO_FILEWRITE,
-                                     "Error writing last byte of the file");
-            return IMAGESTREAMIO_FILEWRITE;
+            numapolicy = IMAGE_NUMA_BIND;
+            numanode = (int16_t)((imagetype & IMAGE_OPT_NUMANODE_MASK) >> IMAGE_OPT_NUMANODE_SHIFT);
+        }
+        else if ((location == -1) && (imagetype & IMAGE_OPT_NUMAINTERLEAVE))
+        {
+            numapolicy = IMAGE_NUMA_INTERLEAVE;
         }
 
-        map = (uint8_t *)mmap(0, sharedsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+        // transparent huge pages are requested and NUMA policy set after
+        // mmap, populate after that
+        uint32_t memrequest = ImageStreamIO_memrequest(imagetype);
+        int mappopulate = (memrequest & IMAGE_MEMSTATUS_POPULATED) &&
+                          ((hugepagesize == 0) || hugetlbfs) &&
+                          (numapolicy == IMAGE_NUMA_DEFAULT);
+
+        map = (uint8_t *)mmap(0, sharedsize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | (mappopulate ? MAP_POPULATE : 0),
                               SM_fd, 0);
         if (map == MAP_FAILED)
         {
@@ -846,11 +1931,47 @@ errno_t ImageStreamIO_createIm_gpu(
             return IMAGESTREAMIO_MMAP;
         }
 
+        if (numapolicy != IMAGE_NUMA_DEFAULT)
+        {
+            size_t pagesize = (hugepagesize > 0) ? hugepagesize : (size_t)sysconf(_SC_PAGESIZE);
+            size_t dataoffset = ImageStreamIO_alignup(sizeof(IMAGE_METADATA), hugepagesize);
+            int err = ImageStreamIO_numa_mbind(map, dataoffset,
+                                               (imagetype & IMAGE_OPT_CBZEROCOPY) ? 0 : datasharedsize,
+                                               pagesize, numapolicy, numanode);
+            if ((err == 0) && (imagetype & (IMAGE_OPT_NUMACB | IMAGE_OPT_CBZEROCOPY)))
+            {
+                err = ImageStreamIO_numa_mbind(map, CBdataoffset, datasharedsize * CBsize,
+                                               pagesize, numapolicy, numanode);
+            }
+            if (err != 0)
+            {
+                char wmsg[200];
+                snprintf(wmsg, sizeof(wmsg), "mbind failed (%s), NUMA placement not applied",
+                         strerror(errno));
+                ImageStreamIO_printWARNING(wmsg);
+                numapolicy = IMAGE_NUMA_DEFAULT;
+                numanode = -1;
+            }
+        }
+
+        if ((hugepagesize > 0) && !hugetlbfs)
+        {
+            ImageStreamIO_madvise_hugepage(SM_fd, map, sharedsize);
+        }
+
+        image->memstatus = ImageStreamIO_memprepare(map, sharedsize, memrequest,
+                           mappopulate, 1);
+
         image->md = (IMAGE_METADATA *)map;
         image->md->shared = 1;
+        image->md->hugepagesize = hugepagesize;
+        image->md->memstatus = image->memstatus;
+        image->md->numapolicy = numapolicy;
+        image->md->numanode = numanode;
         image->md->creatorPID = getpid();
         image->md->ownerPID = 0; // default value, indicates unset
         image->md->sem = NBsem;
+        image->semmapped = NBsem;
         image->md->NBproctrace = NBproctrace;
 
         {
@@ -866,9 +1987,14 @@ errno_t ImageStreamIO_createIm_gpu(
                 file_stat.st_ino; // inode now contains inode number of the file with descriptor fd
         }
 
-        map += sizeof(IMAGE_METADATA);
+        map += ImageStreamIO_alignup(sizeof(IMAGE_METADATA), hugepagesize);
 
-        if (location == -1)
+        if (imagetype & IMAGE_OPT_CBZEROCOPY)
+        {
+            // set below, once CB data is mapped
+            image->array.raw = NULL;
+        }
+        else if (location == -1)
         {
             // CPU
             image->array.raw = map;
@@ -880,45 +2006,85 @@ errno_t ImageStreamIO_createIm_gpu(
             image->array.raw = NULL;
         }
 
+        map = ImageStreamIO_cachealign(map);
         image->kw = (IMAGE_KEYWORD *)(map);
         map += sizeof(IMAGE_KEYWORD) * NBkw;
 
+        map = ImageStreamIO_cachealign(map);
         image->semfile = (SEMFILEDATA*)(map);
         map += sizeof(SEMFILEDATA) * NBsem;
 
+        map = ImageStreamIO_cachealign(map);
         image->semReadPID = (pid_t *)(map);
         map += sizeof(pid_t) * NBsem;
 
+        map = ImageStreamIO_cachealign(map);
         image->semWritePID = (pid_t *)(map);
         map += sizeof(pid_t) * NBsem;
 
+        map = ImageStreamIO_cachealign(map);
         image->semctrl = (uint32_t *)(map);
         map += sizeof(uint32_t) * NBsem;
 
+        map = ImageStreamIO_cachealign(map);
         image->semstatus = (uint32_t *)(map);
         map += sizeof(uint32_t) * NBsem;
 
+        map = ImageStreamIO_cachealign(map);
+        image->semfutex = (SEMFUTEX *)(map);
+        map += sizeof(SEMFUTEX) * (NBsem + 2);
+
+        map = ImageStreamIO_cachealign(map);
+        image->semreader = (SEMREADER *)(map);
+        map += sizeof(SEMREADER) * NBsem;
+
+        map = ImageStreamIO_cachealign(map);
         image->streamproctrace = (STREAM_PROC_TRACE *)(map);
         map += sizeof(STREAM_PROC_TRACE) * NBproctrace;
 
         if ((imagetype & 0xF000F) ==
                 (CIRCULAR_BUFFER | ZAXIS_TEMPORAL)) // If main image is circular buffer
         {
+            map = ImageStreamIO_cachealign(map);
             image->atimearray = (struct timespec *)(map);
             map += sizeof(struct timespec) * size[2];
 
+            map = ImageStreamIO_cachealign(map);
             image->writetimearray = (struct timespec *)(map);
             map += sizeof(struct timespec) * size[2];
 
+            map = ImageStreamIO_cachealign(map);
             image->cntarray = (uint64_t *)(map);
             map += sizeof(uint64_t) * size[2];
         }
+        else
+        {
+            image->atimearray = NULL;
+            image->writetimearray = NULL;
+            image->cntarray = NULL;
+        }
+
+        if (datatype == _DATATYPE_EVENT_UI8_UI8_UI16_UI8)
+        {
+            map = ImageStreamIO_cachealign(map);
+            image->eventbatch = (IMAGE_EVENTBATCH *)(map);
+            map += sizeof(IMAGE_EVENTBATCH) * IMAGE_EVENT_NBBATCH;
+            memset(image->eventbatch, 0, sizeof(IMAGE_EVENTBATCH) * IMAGE_EVENT_NBBATCH);
+        }
+        else
+        {
+            image->eventbatch = NULL;
+        }
 
+        map = ImageStreamIO_cachealign(map);
         image->CircBuff_md = (CBFRAMEMD *)(map);
         map += sizeof(CBFRAMEMD) * CBsize;
 
         if (CBsize > 0)
         {
+            map = (uint8_t *)image->md +
+                  ImageStreamIO_alignup(map - (uint8_t *)image->md, hugepagesize);
+            map = ImageStreamIO_cachealign(map);
             image->CBimdata = map;
         }
         else
@@ -929,9 +2095,17 @@ errno_t ImageStreamIO_createIm_gpu(
         image->md->CBsize = CBsize;
         image->md->CBindex = 0;
         image->md->CBcycle = 0;
+        memset(image->CircBuff_md, 0, sizeof(CBFRAMEMD) * CBsize);
+
+        if (imagetype & IMAGE_OPT_CBZEROCOPY)
+        {
+            // first frame is written into slot 1, slot 0 holds the initial (zero) frame
+            image->array.raw = (uint8_t *)image->CBimdata + datasharedsize;
+        }
 
 
 #ifdef IMAGESTRUCT_WRITEHISTORY
+        map = ImageStreamIO_cachealign(map);
         image->writehist = (FRAMEWRITEMD *)(map);
         map += sizeof(FRAMEWRITEMD) * IMAGESTRUCT_FRAMEWRITEMDSIZE;
 
@@ -945,14 +2119,28 @@ errno_t ImageStreamIO_createIm_gpu(
         image->shmfd = 0;
         image->memsize = 0;
 
-        image->md = (IMAGE_METADATA *)malloc(sizeof(IMAGE_METADATA));
-        if (image->md == NULL)
+        // keep the writer-hot metadata lines aligned as in shared streams
+        image->md = NULL;
+        if (posix_memalign((void **)&image->md, IMAGE_CACHELINE_SIZE,
+                           sizeof(IMAGE_METADATA)) != 0)
         {
             printf("Memory allocation error %s %d\n", __FILE__, __LINE__);
             abort();
         }
         image->md->shared = 0;
+        image->md->hugepagesize = 0;
+        image->md->memstatus = 0;
+        image->memstatus = 0;
+        image->md->numapolicy = IMAGE_NUMA_DEFAULT;
+        image->md->numanode = -1;
+        image->semmapped = 0;
         image->md->inode = 0;
+        image->semfutex = NULL;
+        image->semreader = NULL;
+        image->atimearray = NULL;
+        image->writetimearray = NULL;
+        image->cntarray = NULL;
+        image->eventbatch = NULL;
         if (NBkw > 0)
         {
             image->kw = (IMAGE_KEYWORD *)malloc(sizeof(IMAGE_KEYWORD) * NBkw);
@@ -995,7 +2183,11 @@ errno_t ImageStreamIO_createIm_gpu(
 
     image->md->NBkw = NBkw;
 
-    ImageStreamIO_initialize_buffer(image);
+    if ((shared != 1) || (location != -1))
+    {
+        // shared CPU data is in a new file, already zero pages
+        ImageStreamIO_initialize_buffer(image);
+    }
 
     clock_gettime(CLOCK_ISIO, &image->md->lastaccesstime);
     clock_gettime(CLOCK_ISIO, &image->md->creationtime);
@@ -1006,6 +2198,13 @@ errno_t ImageStreamIO_createIm_gpu(
     image->md->write = 0;
     image->md->cnt0 = 0;
     image->md->cnt1 = 0;
+    image->md->cnt2 = 0;
+    image->md->cnt2next = 0;
+    image->md->flowpolicy = IMAGE_FLOW_OVERWRITE;
+    image->md->flowdropcnt = 0;
+    image->md->CBticket = 0;
+    image->md->publishPID = 0;
+    image->md->slicelostcnt = 0;
 
     if (shared == 1)
     {
@@ -1017,8 +2216,10 @@ errno_t ImageStreamIO_createIm_gpu(
         {
             image->semReadPID[semindex] = -1;
             image->semWritePID[semindex] = -1;
-            image->semctrl[semindex] = 0;
+            image->semctrl[semindex] = IMAGE_SEMAPHORE_CONTROL_READY;
             image->semstatus[semindex] = 0;
+            image->semreader[semindex].cnt0 = 0;
+            image->semreader[semindex].lease = 0;
         }
 
         for (int proctraceindex = 0; proctraceindex < NBproctrace; proctraceindex++)
@@ -1044,6 +2245,15 @@ errno_t ImageStreamIO_createIm_gpu(
         image->kw[kw].type = 'N';
     }
 
+    if (image->md->shared == 1)
+    {
+        ImageStreamIO_registry_add(image);
+    }
+
+    // frame copies single-threaded until ImageStreamIO_set_copythreads
+    image->copythreads = 0;
+    image->copyminsize = IMAGE_COPYPOOL_MINSIZE;
+
     image->used = 1;
     image->createcnt++;
 
@@ -1077,8 +2287,24 @@ errno_t ImageStreamIO_destroyIm(
 
         char fname[512];
 
+        if (image->memsize > 0)
+        {
+            ImageStreamIO_teardown(image);
+
+            // cached handle: other handles sharing the mapping become invalid
+            sem_t *cachedsemlog = NULL;
+            if ((ImageStreamIO_opencache_evict(image, &cachedsemlog) == 1) &&
+                    (cachedsemlog != NULL) && (cachedsemlog != image->semlog))
+            {
+                sem_close(cachedsemlog);
+            }
+        }
+
         // close and remove semlog
-        sem_close(image->semlog);
+        if (image->semlog != NULL)
+        {
+            sem_close(image->semlog);
+        }
         snprintf(fname, sizeof(fname), "/dev/shm/sem.%s.%s_semlog", shmdirname,
                  image->md->name);
         sem_unlink(fname);
@@ -1094,11 +2320,16 @@ errno_t ImageStreamIO_destroyIm(
             close(image->shmfd);
             // Get this before unmapping.
             ImageStreamIO_filename(fname, sizeof(fname), image->md->name);
+            char name[STRINGMAXLEN_IMAGE_NAME];
+            strncpy(name, image->md->name, sizeof(name));
+            name[sizeof(name)-1] = '\0';
+            ino_t inode = image->md->inode;
             munmap(image->md, image->memsize);
             image->md = NULL;
             image->kw = NULL;
             // Remove the file
             remove(fname);
+            ImageStreamIO_registry_remove(name, inode);
         }
         else
         {
@@ -1160,6 +2391,149 @@ void *ImageStreamIO_get_image_d_ptr(
     return d_ptr;
 }
 
+void *ImageStreamIO_get_latest_ptr(
+    const IMAGE *image)
+{
+    if (image->md->imagetype & IMAGE_OPT_CBZEROCOPY)
+    {
+        return ImageStreamIO_CBslotptr(image,
+                                       __atomic_load_n(&image->md->CBindex, __ATOMIC_ACQUIRE));
+    }
+    return image->array.raw;
+}
+
+// Named semaphores of a shmim, attached by ImageStreamIO_openIm_flags
+// or on first use (IMAGE_OPEN_LAZYSEM)
+
+// name of semaphore index, semlog if index == md->sem
+static void ImageStreamIO_semname(
+    const IMAGE *image,
+    long index,
+    char *sname,
+    size_t ssz)
+{
+    // Get shm directory name (only on first call to this function)
+    static char shmdirname[200];
+    static int initSHAREDMEMDIR = 0;
+    static char shmdirnamepfx[200 - 14 - sizeof(image->md->name)];
+    if (initSHAREDMEMDIR == 0)
+    {
+        unsigned int stri;
+
+        ImageStreamIO_shmdirname(shmdirname);
+        for (stri = 0; stri < strlen(shmdirname); stri++)
+        {
+            if (shmdirname[stri] == '/') // replace leading '/' by '.'
+            {
+                shmdirname[stri] = '.';
+            }
+        }
+        strncpy(shmdirnamepfx, shmdirname, sizeof(shmdirnamepfx));
+        shmdirnamepfx[sizeof(shmdirnamepfx)-1] = '\0';
+        initSHAREDMEMDIR = 1;
+    }
+
+    if (index == image->md->sem)
+    {
+        snprintf(sname, ssz, "%s.%s_semlog", shmdirnamepfx, image->md->name);
+    }
+    else
+    {
+        snprintf(sname, ssz, "%s.%s_sem%02ld", shmdirnamepfx, image->md->name, index);
+    }
+}
+
+// open semaphore index (semlog if index == md->sem), (re-)create it if missing
+static sem_t *ImageStreamIO_opennamedsem(
+    IMAGE *image,
+    long index)
+{
+    char sname[200] = {0};
+    sem_t *sem;
+
+    ImageStreamIO_semname(image, index, sname, sizeof(sname));
+    umask(0);
+    if ((sem = sem_open(sname, 0, FILEMODE, 0)) != SEM_FAILED)
+    {
+        return sem;
+    }
+
+    // printf("ERROR: could not open semaphore %s -> (re-)CREATING semaphore\n",
+    //        sname);
+    if ((sem = sem_open(sname, O_CREAT, FILEMODE, 1)) == SEM_FAILED)
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_SEMINIT, "semaphore initialization");
+        return NULL;
+    }
+    sem_init(sem, 1,
+             SEMAPHORE_INITVAL); // SEMAPHORE_INITVAL defined in ImageStruct.h
+
+    if (index < image->md->sem)
+    {
+        // get semaphore inode
+        struct stat file_stat = {0};
+        char fullsname[13 + sizeof(sname)];
+
+        snprintf(fullsname, sizeof(fullsname), "/dev/shm/sem.%s", sname);
+
+        int fd = open(fullsname, O_RDONLY);
+        if (fd >= 0)
+        {
+            fstat(fd, &file_stat);
+            close(fd);
+        }
+        strncpy(image->semfile[index].fname, sname, STRINGMAXLEN_SEMFILENAME);
+        image->semfile[index].fname[STRINGMAXLEN_SEMFILENAME-1] = '\0';
+
+        image->semfile[index].inode = file_stat.st_ino;
+    }
+
+    return sem;
+}
+
+// semaphore index (semlog if index == md->sem), attached on first call
+// returns NULL if the semaphore cannot be opened
+static sem_t *ImageStreamIO_getsemptr(
+    IMAGE *image,
+    long index)
+{
+    sem_t **semslot;
+
+    if (index == image->md->sem)
+    {
+        semslot = &image->semlog;
+    }
+    else if (image->semptr != NULL)
+    {
+        semslot = &image->semptr[index];
+    }
+    else
+    {
+        return NULL;
+    }
+
+    sem_t *sem = __atomic_load_n(semslot, __ATOMIC_ACQUIRE);
+    if (sem != NULL)
+    {
+        return sem;
+    }
+
+    if ((sem = ImageStreamIO_opennamedsem(image, index)) == NULL)
+    {
+        return NULL;
+    }
+
+    sem_t *attached = NULL;
+    if (!__atomic_compare_exchange_n(semslot, &attached, sem, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        // attached by another thread meanwhile
+        sem_close(sem);
+        sem = attached;
+    }
+    return sem;
+}
+
 /**
  * ## Purpose
  *
@@ -1174,6 +2548,15 @@ void *ImageStreamIO_get_image_d_ptr(
 errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
     const char *name,
     IMAGE *image)
+{
+    return ImageStreamIO_openIm_flags(image, name, 0);
+}
+
+// map stream and attach semaphores, one new mapping per call
+static errno_t ImageStreamIO_openIm_map(
+    IMAGE *image,
+    const char *name,
+    int flags)
 {
     int SM_fd;
     char SM_fname[STRINGMAXLEN_FILE_NAME] = {0};
@@ -1191,42 +2574,35 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
     }
     // open() was successful. We'll need to close SM_fd for any failed exit
 
-    char sname[200] = {0};
     uint8_t *map = NULL;
     uint8_t *map_root = NULL;
     long s;
     struct stat file_stat = {0};
 
-    int snb = 0;
-    int sOK = 1;
-
-    // Get shm directory name (only on first call to this function)
-    static char shmdirname[200];
-    static int initSHAREDMEMDIR = 0;
-    static char shmdirnamepfx[sizeof(sname) - 14 - sizeof(image->md->name)];
-    if (initSHAREDMEMDIR == 0)
-    {
-        unsigned int stri;
-
-        ImageStreamIO_shmdirname(shmdirname);
-        for (stri = 0; stri < strlen(shmdirname); stri++)
-        {
-            if (shmdirname[stri] == '/') // replace leading '/' by '.'
-            {
-                shmdirname[stri] = '.';
-            }
-        }
-        strncpy(shmdirnamepfx, shmdirname, sizeof(shmdirnamepfx));
-        shmdirnamepfx[sizeof(shmdirnamepfx)-1] = '\0';
-        initSHAREDMEMDIR = 1;
-    }
-
     fstat(SM_fd, &file_stat);
 
     // printf("File %s size: %zd\n", SM_fname, file_stat.st_size); fflush(stdout); //TEST
 
+    // memory preparation: open flags and stream options, read before mapping
+    uint64_t imagetype = 0;
+    uint64_t hugepagesize = 0;
+    if ((pread(SM_fd, &imagetype, sizeof(imagetype),
+               offsetof(IMAGE_METADATA, imagetype)) != sizeof(imagetype)) ||
+            (pread(SM_fd, &hugepagesize, sizeof(hugepagesize),
+                   offsetof(IMAGE_METADATA, hugepagesize)) != sizeof(hugepagesize)))
+    {
+        imagetype = 0;
+        hugepagesize = 0;
+    }
+    uint32_t memrequest = ImageStreamIO_memrequest(imagetype) |
+                          ((flags & IMAGE_OPEN_POPULATE) ? IMAGE_MEMSTATUS_POPULATED : 0) |
+                          ((flags & IMAGE_OPEN_MLOCK) ? IMAGE_MEMSTATUS_LOCKED : 0) |
+                          ((flags & IMAGE_OPEN_PRETOUCH) ? IMAGE_MEMSTATUS_PRETOUCHED : 0);
+    // with transparent huge pages, populate once advised
+    int mappopulate = (memrequest & IMAGE_MEMSTATUS_POPULATED) && (hugepagesize == 0);
+
     map_root = (uint8_t *)mmap(0, file_stat.st_size, PROT_READ | PROT_WRITE,
-                          MAP_SHARED, SM_fd, 0);
+                          MAP_SHARED | (mappopulate ? MAP_POPULATE : 0), SM_fd, 0);
     map = map_root;
     if (map_root == MAP_FAILED)
     {
@@ -1237,8 +2613,11 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
 
     image->memsize = file_stat.st_size;
     image->shmfd = SM_fd;
+    image->copythreads = 0;
+    image->copyminsize = IMAGE_COPYPOOL_MINSIZE;
     image->md = (IMAGE_METADATA *)map;
     image->md->shared = 1;
+    image->semmapped = image->md->sem;
 
     if (strcmp(image->md->version, IMAGESTRUCT_VERSION))
     {
@@ -1279,7 +2658,14 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
         }
     }
 
-    map += sizeof(IMAGE_METADATA);
+    if (image->md->hugepagesize > 0)
+    {
+        ImageStreamIO_madvise_hugepage(SM_fd, map_root, image->memsize);
+    }
+    image->memstatus = ImageStreamIO_memprepare(map_root, image->memsize, memrequest,
+                       mappopulate, 0);
+
+    map += ImageStreamIO_alignup(sizeof(IMAGE_METADATA), image->md->hugepagesize);
 
     // gain image data array pointer
     if (image->md->location >= 0)
@@ -1298,6 +2684,7 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
 
     // printf("%ld keywords\n", (long)image->md->NBkw); fflush(stdout); //TEST
 
+    map = ImageStreamIO_cachealign(map);
     image->kw = (IMAGE_KEYWORD *)(map);
     map += sizeof(IMAGE_KEYWORD) * image->md->NBkw;
     ///<\todo can the following code be deleted?
@@ -1316,21 +2703,35 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
       }
     */
 
+    map = ImageStreamIO_cachealign(map);
     image->semfile = (SEMFILEDATA *)(map);
     map += sizeof(SEMFILEDATA) * image->md->sem;
 
+    map = ImageStreamIO_cachealign(map);
     image->semReadPID = (pid_t *)(map);
     map += sizeof(pid_t) * image->md->sem;
 
+    map = ImageStreamIO_cachealign(map);
     image->semWritePID = (pid_t *)(map);
     map += sizeof(pid_t) * image->md->sem;
 
+    map = ImageStreamIO_cachealign(map);
     image->semctrl = (uint32_t *)(map);
     map += sizeof(uint32_t) * image->md->sem;
 
+    map = ImageStreamIO_cachealign(map);
     image->semstatus = (uint32_t *)(map);
     map += sizeof(uint32_t) * image->md->sem;
 
+    map = ImageStreamIO_cachealign(map);
+    image->semfutex = (SEMFUTEX *)(map);
+    map += sizeof(SEMFUTEX) * (image->md->sem + 2);
+
+    map = ImageStreamIO_cachealign(map);
+    image->semreader = (SEMREADER *)(map);
+    map += sizeof(SEMREADER) * image->md->sem;
+
+    map = ImageStreamIO_cachealign(map);
     image->streamproctrace = (STREAM_PROC_TRACE *)(map);
     map += sizeof(STREAM_PROC_TRACE) * image->md->NBproctrace;
 
@@ -1340,22 +2741,46 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
         // printf("circuar buffer\n"); fflush(stdout); //TEST
 
         // Circular buffer
+        map = ImageStreamIO_cachealign(map);
         image->atimearray = (struct timespec *)(map);
         map += sizeof(struct timespec) * image->md->size[2];
 
+        map = ImageStreamIO_cachealign(map);
         image->writetimearray = (struct timespec *)(map);
         map += sizeof(struct timespec) * image->md->size[2];
 
+        map = ImageStreamIO_cachealign(map);
         image->cntarray = (uint64_t *)(map);
         map += sizeof(uint64_t) * image->md->size[2];
     }
+    else
+    {
+        image->atimearray = NULL;
+        image->writetimearray = NULL;
+        image->cntarray = NULL;
+    }
+
+    if (image->md->datatype == _DATATYPE_EVENT_UI8_UI8_UI16_UI8)
+    {
+        map = ImageStreamIO_cachealign(map);
+        image->eventbatch = (IMAGE_EVENTBATCH *)map;
+        map += sizeof(IMAGE_EVENTBATCH) * IMAGE_EVENT_NBBATCH;
+    }
+    else
+    {
+        image->eventbatch = NULL;
+    }
 
     if (image->md->CBsize > 0)
     {
+        map = ImageStreamIO_cachealign(map);
         image->CircBuff_md = (CBFRAMEMD *)map;
         map += sizeof(CBFRAMEMD) * image->md->CBsize;
 
+        map = map_root + ImageStreamIO_alignup(map - map_root, image->md->hugepagesize);
+        map = ImageStreamIO_cachealign(map);
         image->CBimdata = map;
+        map += image->md->imdatamemsize * image->md->CBsize;
     }
     else
     {
@@ -1363,108 +2788,52 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
         image->CBimdata = NULL;
     }
 
+    if (image->md->imagetype & IMAGE_OPT_CBZEROCOPY)
+    {
+        // array.raw is where this process writes next frame
+        image->array.raw = ImageStreamIO_CBslotptr(image,
+                           (__atomic_load_n(&image->md->CBindex, __ATOMIC_ACQUIRE) + 1) % image->md->CBsize);
+    }
+
 #ifdef IMAGESTRUCT_WRITEHISTORY
+    map = ImageStreamIO_cachealign(map);
     image->writehist = (FRAMEWRITEMD *)map;
     map += sizeof(FRAMEWRITEMD) * IMAGESTRUCT_FRAMEWRITEMDSIZE;
 #endif
 
     strncpy(image->name, name, STRINGMAXLEN_IMAGE_NAME - 1);
 
-    // looking for semaphores
-    // printf("Looking for semaphores\n"); fflush(stdout); //TEST
-    while (sOK == 1)
+    if (image->md->imagetype & IMAGE_OPT_FUTEX)
     {
-        snprintf(sname, sizeof(sname), "%s.%s_sem%02d", shmdirnamepfx
-                , image->md->name, snb);
-        sem_t *stest;
-        umask(0);
-        if ((stest = sem_open(sname, 0, FILEMODE, 0)) == SEM_FAILED)
-        {
-            sOK = 0; // not an error here
-        }
-        else
-        {
-            sem_close(stest);
-            snb++;
-        }
+        // semaphores live in the stream, nothing to open
+        image->semptr = NULL;
+        image->semlog = NULL;
+        return IMAGESTREAMIO_SUCCESS;
     }
 
-    //        image->md->sem = snb;
-    image->semptr = (sem_t **)malloc(sizeof(sem_t *) * image->md->sem);
+    image->semptr = (sem_t **)calloc(image->md->sem, sizeof(sem_t *));
     if (image->semptr == NULL)
     {
         printf("Memory allocation error %s %d\n", __FILE__, __LINE__);
         abort();
     }
-    for (s = 0; s < image->md->sem; s++)
-    {
-        snprintf(sname, sizeof(sname), "%s.%s_sem%02ld", shmdirnamepfx
-                , image->md->name, s);
-        umask(0);
-        if ((image->semptr[s] = sem_open(sname, 0, FILEMODE, 0)) == SEM_FAILED)
-        {
-            // printf("ERROR: could not open semaphore %s -> (re-)CREATING semaphore\n",
-            //        sname);
-
-            if ((image->semptr[s] = sem_open(sname, O_CREAT, FILEMODE, 1)) ==
-                    SEM_FAILED)
-            {
-                ImageStreamIO_printERROR(IMAGESTREAMIO_SEMINIT, "semaphore initialization");
-                munmap(map_root, image->memsize);
-                close(SM_fd);
-                return IMAGESTREAMIO_SEMINIT;
-            }
-            else
-            {
-                sem_init(
-                    image->semptr[s], 1,
-                    SEMAPHORE_INITVAL); // SEMAPHORE_INITVAL defined in ImageStruct.h
-            }
-
-
-            // get semaphore inode
-            {
-                struct stat file_stat;
-                int ret;
-                char fullsname[13 + sizeof(sname)];
-
-                snprintf(fullsname, sizeof(fullsname), "/dev/shm/sem.%s", sname);
-
-
-                int fd = open(fullsname, O_RDONLY);
-                ret = fstat (fd, &file_stat);
-                if (ret < 0) {
-                    // error getting file stat
-                }
-                //snprintf(image->semfile[s].fname, STRINGMAXLEN_SEMFILENAME, "%s", sname);
-                strncpy(image->semfile[s].fname, sname, STRINGMAXLEN_SEMFILENAME);
-                image->semfile[s].fname[STRINGMAXLEN_SEMFILENAME-1] = '\0';
+    image->semlog = NULL;
 
-                image->semfile[s].inode = file_stat.st_ino;
-                close(fd);
-            }
-        }
+    if (flags & IMAGE_OPEN_LAZYSEM)
+    {
+        // semaphores are attached on first use
+        return IMAGESTREAMIO_SUCCESS;
     }
 
-    snprintf(sname, sizeof(sname), "%s.%s_semlog", shmdirnamepfx, image->md->name);
-    umask(0);
-    if ((image->semlog = sem_open(sname, 0, FILEMODE, 0)) == SEM_FAILED)
+    // semlog is at index md->sem
+    for (s = 0; s <= image->md->sem; s++)
     {
-        // printf("ERROR: could not open semaphore %s -> (re-)CREATING semaphore\n",
-        //        sname);
-        if ((image->semlog = sem_open(sname, O_CREAT, FILEMODE, 1)) == SEM_FAILED)
+        if (ImageStreamIO_getsemptr(image, s) == NULL)
         {
-            ImageStreamIO_printERROR(IMAGESTREAMIO_SEMINIT, "semaphore initialization");
             munmap(map_root, image->memsize);
             close(SM_fd);
             return IMAGESTREAMIO_SEMINIT;
         }
-        else
-        {
-            sem_init(
-                image->semlog, 1,
-                SEMAPHORE_INITVAL); // SEMAPHORE_INITVAL defined in ImageStruct.h
-        }
     }
 
     return IMAGESTREAMIO_SUCCESS;
@@ -1477,49 +2846,451 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
 
 
 
-errno_t ImageStreamIO_closeIm(
-    IMAGE *image)
+// Open cache (IMAGE_OPEN_CACHED, ImageStreamIO_set_opencache)
+// Process-local table of stream mappings keyed by name and inode. A cached
+// open copies the IMAGE of the entry, so all handles share one mapping and
+// one semaphore pointer array; ImageStreamIO_closeIm drops a reference and
+// unmaps on the last one. Streams re-created under the same name have a
+// new inode and get a new entry. When the table is full, opens are not
+// cached. ImageStreamIO_destroyIm removes the entry of the handle it is
+// given, invalidating the other handles sharing it.
+
+#define IMAGESTREAMIO_OPENCACHE_NBENTRY 256
+
+typedef struct
 {
-    long s;
+    int   refcnt;   // handles sharing the mapping, 0 if entry is free
+    ino_t inode;
+    IMAGE image;    // handle the others are copied from
+} IMAGESTREAMIO_OPENCACHE_ENTRY;
 
-    for (s = 0; s < image->md->sem; s++)
+typedef struct
+{
+    pthread_mutex_t lock;
+    int enabled;    // all opens are cached, see ImageStreamIO_set_opencache
+    int nbentry;    // entries in use
+    IMAGESTREAMIO_OPENCACHE_ENTRY entry[IMAGESTREAMIO_OPENCACHE_NBENTRY];
+} IMAGESTREAMIO_OPENCACHE;
+
+static IMAGESTREAMIO_OPENCACHE ImageStreamIO_opencache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static errno_t ImageStreamIO_opencache_open(
+    IMAGE *image,
+    const char *name,
+    int flags)
+{
+    IMAGESTREAMIO_OPENCACHE *cache = &ImageStreamIO_opencache;
+    char SM_fname[STRINGMAXLEN_FILE_NAME];
+    struct stat file_stat;
+
+    ImageStreamIO_filename(SM_fname, sizeof(SM_fname), name);
+    if (stat(SM_fname, &file_stat) != 0)
     {
-        sem_close(image->semptr[s]);
+        // reported by uncached open
+        return ImageStreamIO_openIm_map(image, name, flags);
     }
 
-    free(image->semptr);
+    pthread_mutex_lock(&cache->lock);
+
+    IMAGESTREAMIO_OPENCACHE_ENTRY *freeentry = NULL;
+    for (int e = 0; e < IMAGESTREAMIO_OPENCACHE_NBENTRY; e++)
+    {
+        IMAGESTREAMIO_OPENCACHE_ENTRY *entry = &cache->entry[e];
+        if (entry->refcnt == 0)
+        {
+            if (freeentry == NULL)
+            {
+                freeentry = entry;
+            }
+            continue;
+        }
+        if ((entry->inode == file_stat.st_ino) &&
+                (strncmp(entry->image.name, name, STRINGMAXLEN_IMAGE_NAME - 1) == 0))
+        {
+            uint32_t memrequest = ((flags & IMAGE_OPEN_POPULATE) ? IMAGE_MEMSTATUS_POPULATED : 0) |
+                                  ((flags & IMAGE_OPEN_MLOCK) ? IMAGE_MEMSTATUS_LOCKED : 0) |
+                                  ((flags & IMAGE_OPEN_PRETOUCH) ? IMAGE_MEMSTATUS_PRETOUCHED : 0);
+            memrequest &= ~entry->image.memstatus;
+            if (memrequest != 0)
+            {
+                // preparation not done by previous opens
+                entry->image.memstatus |= ImageStreamIO_memprepare(
+                                              (uint8_t *)entry->image.md, entry->image.memsize,
+                                              memrequest, 0, 0);
+            }
+            entry->refcnt++;
+            *image = entry->image;
+            pthread_mutex_unlock(&cache->lock);
+            return IMAGESTREAMIO_SUCCESS;
+        }
+    }
 
-    sem_close(image->semlog);
+    if (freeentry == NULL)
+    {
+        pthread_mutex_unlock(&cache->lock);
+        return ImageStreamIO_openIm_map(image, name, flags);
+    }
 
-    if (munmap(image->md, image->memsize) != 0)
+    errno_t ret = ImageStreamIO_openIm_map(&freeentry->image, name, flags);
+    if (ret == IMAGESTREAMIO_SUCCESS)
     {
-        ImageStreamIO_printERROR(IMAGESTREAMIO_MMAP, "error unmapping memory");
-        return IMAGESTREAMIO_MMAP;
+        freeentry->inode = file_stat.st_ino;
+        freeentry->refcnt = 1;
+        cache->nbentry++;
+        *image = freeentry->image;
+    }
+    else
+    {
+        image->used = 0;
     }
+    pthread_mutex_unlock(&cache->lock);
 
-    return IMAGESTREAMIO_SUCCESS;
+    return ret;
 }
 
-/* ===============================================================================================
- */
-/* ===============================================================================================
- */
-/* @name 2. MANAGE SEMAPHORES
- *
- */
-/* ===============================================================================================
- */
-/* ===============================================================================================
- */
+// drop reference of cached handle, semlog set to the entry's semlog
+// returns -1 if not cached, else remaining references
+static int ImageStreamIO_opencache_release(
+    const IMAGE *image,
+    sem_t **semlog)
+{
+    IMAGESTREAMIO_OPENCACHE *cache = &ImageStreamIO_opencache;
+    int refcnt = -1;
 
-/**
- * ## Purpose
- *
- * Destroy semaphore of a shmim
- *
- * ## Arguments
- *
- * @param[in]
+    pthread_mutex_lock(&cache->lock);
+    for (int e = 0; (e < IMAGESTREAMIO_OPENCACHE_NBENTRY) && (cache->nbentry > 0); e++)
+    {
+        IMAGESTREAMIO_OPENCACHE_ENTRY *entry = &cache->entry[e];
+        if ((entry->refcnt > 0) && (entry->image.md == image->md))
+        {
+            *semlog = entry->image.semlog;
+            refcnt = --entry->refcnt;
+            if (refcnt == 0)
+            {
+                cache->nbentry--;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return refcnt;
+}
+
+// remove entry of cached handle, whatever its references
+// semlog set to the entry's semlog, returns 1 if entry found
+static int ImageStreamIO_opencache_evict(
+    const IMAGE *image,
+    sem_t **semlog)
+{
+    IMAGESTREAMIO_OPENCACHE *cache = &ImageStreamIO_opencache;
+    int found = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    for (int e = 0; (e < IMAGESTREAMIO_OPENCACHE_NBENTRY) && (cache->nbentry > 0); e++)
+    {
+        IMAGESTREAMIO_OPENCACHE_ENTRY *entry = &cache->entry[e];
+        if ((entry->refcnt > 0) && (entry->image.md == image->md))
+        {
+            *semlog = entry->image.semlog;
+            entry->refcnt = 0;
+            cache->nbentry--;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return found;
+}
+
+errno_t ImageStreamIO_set_opencache(
+    int enable)
+{
+    pthread_mutex_lock(&ImageStreamIO_opencache.lock);
+    ImageStreamIO_opencache.enabled = enable ? 1 : 0;
+    pthread_mutex_unlock(&ImageStreamIO_opencache.lock);
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+/**
+ * ## Purpose
+ *
+ * Connect to shared memory image, with IMAGE_OPEN_XXX flags
+ *
+ * ## Arguments
+ *
+ * @param[out]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * name     stream name
+ *
+ * @param[in]
+ * flags    IMAGE_OPEN_XXX flags, OR-ed
+ *
+ **/
+errno_t ImageStreamIO_openIm_flags(
+    IMAGE *image,
+    const char *name,
+    int flags)
+{
+    if ((flags & IMAGE_OPEN_CACHED) ||
+            __atomic_load_n(&ImageStreamIO_opencache.enabled, __ATOMIC_RELAXED))
+    {
+        return ImageStreamIO_opencache_open(image, name, flags);
+    }
+    return ImageStreamIO_openIm_map(image, name, flags);
+}
+
+errno_t ImageStreamIO_closeIm(
+    IMAGE *image)
+{
+    long s;
+    sem_t *cachedsemlog = NULL;
+
+    // semlog attached on first use (IMAGE_OPEN_LAZYSEM) by a cached handle
+    // is its own, not the entry's
+    int refcnt = ImageStreamIO_opencache_release(image, &cachedsemlog);
+    if (refcnt > 0)
+    {
+        // mapping still used by other handles of this process
+        if ((image->semlog != NULL) && (image->semlog != cachedsemlog))
+        {
+            sem_close(image->semlog);
+        }
+        image->semptr = NULL;
+        image->semlog = NULL;
+        return IMAGESTREAMIO_SUCCESS;
+    }
+    if ((refcnt == 0) && (cachedsemlog != NULL) && (cachedsemlog != image->semlog))
+    {
+        sem_close(cachedsemlog);
+    }
+
+    if (image->semptr != NULL)
+    {
+        for (s = 0; s < image->md->sem; s++)
+        {
+            if (image->semptr[s] != NULL)
+            {
+                sem_close(image->semptr[s]);
+            }
+        }
+
+        free(image->semptr);
+        image->semptr = NULL;
+    }
+
+    if (image->semlog != NULL)
+    {
+        sem_close(image->semlog);
+        image->semlog = NULL;
+    }
+
+    if (munmap(image->md, image->memsize) != 0)
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_MMAP, "error unmapping memory");
+        return IMAGESTREAMIO_MMAP;
+    }
+    close(image->shmfd);
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+/* ===============================================================================================
+ */
+/* ===============================================================================================
+ */
+/* @name 2. MANAGE SEMAPHORES
+ *
+ */
+/* ===============================================================================================
+ */
+/* ===============================================================================================
+ */
+
+// Futex semaphores (IMAGE_OPT_FUTEX)
+// Counting semaphores held in the stream itself. Posting is a CAS on the
+// value, plus a FUTEX_WAKE only if a reader sleeps on it.
+// Waits use absolute CLOCK_REALTIME timeouts, as sem_timedwait.
+//
+// Broadcast mode (IMAGE_OPT_BROADCAST): readers sleep on a single
+// generation word, semfutex[md->sem + 1]. A post increments the counters
+// of connected readers only, bumps the generation and issues at most one
+// FUTEX_WAKE for all sleepers.
+
+static inline long ImageStreamIO_futex(
+    uint32_t *uaddr,
+    int futex_op,
+    uint32_t val,
+    const struct timespec *timeout,
+    uint32_t val3)
+{
+    // shared mapping: no FUTEX_PRIVATE_FLAG
+    return syscall(SYS_futex, uaddr, futex_op, val, timeout, NULL, val3);
+}
+
+static inline int ImageStreamIO_usefutex(
+    const IMAGE *image)
+{
+    return (image->md->imagetype & IMAGE_OPT_FUTEX) ? 1 : 0;
+}
+
+static inline int ImageStreamIO_usebroadcast(
+    const IMAGE *image)
+{
+    return (image->md->imagetype & IMAGE_OPT_BROADCAST) ? 1 : 0;
+}
+
+// generation word readers sleep on, NULL if readers sleep on their own counter
+static inline SEMFUTEX *ImageStreamIO_futexwakeword(
+    const IMAGE *image)
+{
+    return ImageStreamIO_usebroadcast(image) ? &image->semfutex[image->md->sem + 1] : NULL;
+}
+
+// returns 1 if counter was incremented, 0 if already at SEMAPHORE_MAXVAL
+static inline int ImageStreamIO_futexsem_increment(
+    SEMFUTEX *fsem)
+{
+    uint32_t semval = __atomic_load_n(&fsem->value, __ATOMIC_RELAXED);
+    do
+    {
+        if (semval >= SEMAPHORE_MAXVAL)
+        {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&fsem->value, &semval, semval + 1, 1,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    return 1;
+}
+
+static void ImageStreamIO_futexsem_post(
+    SEMFUTEX *fsem)
+{
+    if (!ImageStreamIO_futexsem_increment(fsem))
+    {
+        return;
+    }
+
+    // pairs with the nwaiters increment in ImageStreamIO_futexsem_wait
+    if (__atomic_load_n(&fsem->nwaiters, __ATOMIC_SEQ_CST) > 0)
+    {
+        ImageStreamIO_futex(&fsem->value, FUTEX_WAKE, 1, NULL, 0);
+    }
+}
+
+static void ImageStreamIO_futexsem_broadcast(
+    SEMFUTEX *wakeword)
+{
+    __atomic_fetch_add(&wakeword->value, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&wakeword->nwaiters, __ATOMIC_SEQ_CST) > 0)
+    {
+        ImageStreamIO_futex(&wakeword->value, FUTEX_WAKE, INT_MAX, NULL, 0);
+    }
+}
+
+static inline int ImageStreamIO_futexsem_trydecrement(
+    SEMFUTEX *fsem)
+{
+    uint32_t semval = __atomic_load_n(&fsem->value, __ATOMIC_RELAXED);
+    while (semval > 0)
+    {
+        if (__atomic_compare_exchange_n(&fsem->value, &semval, semval - 1, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Wait on fsem. Sleeps on wakeword if not NULL (broadcast), on fsem otherwise.
+// returns 0 on success, -1 with errno set (EAGAIN, ETIMEDOUT, EINTR) otherwise
+static int ImageStreamIO_futexsem_wait(
+    SEMFUTEX *fsem,
+    SEMFUTEX *wakeword,
+    const struct timespec *abstime,
+    int trywait)
+{
+    SEMFUTEX *sleepword = (wakeword != NULL) ? wakeword : fsem;
+
+    for (;;)
+    {
+        if (ImageStreamIO_futexsem_trydecrement(fsem))
+        {
+            return 0;
+        }
+        if (trywait)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        long rv = 0;
+        int  err = 0;
+        uint32_t sleepval = (wakeword != NULL) ? __atomic_load_n(&wakeword->value, __ATOMIC_SEQ_CST) : 0;
+        __atomic_fetch_add(&sleepword->nwaiters, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&fsem->value, __ATOMIC_SEQ_CST) == 0)
+        {
+            rv = ImageStreamIO_futex(&sleepword->value,
+                                     FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME,
+                                     sleepval, abstime, FUTEX_BITSET_MATCH_ANY);
+            err = errno;
+        }
+        __atomic_fetch_sub(&sleepword->nwaiters, 1, __ATOMIC_SEQ_CST);
+
+        if ((rv == -1) && ((err == ETIMEDOUT) || (err == EINTR) || (err == EINVAL)))
+        {
+            errno = err;
+            return -1;
+        }
+        // woken up, or value changed before sleeping (EAGAIN): try again
+    }
+}
+
+// reader side entry point, marks the semaphore as connected in broadcast mode
+static int ImageStreamIO_futexsem_waitindex(
+    IMAGE *image,
+    int index,
+    const struct timespec *abstime,
+    int trywait)
+{
+    SEMFUTEX *wakeword = ImageStreamIO_futexwakeword(image);
+
+    if ((wakeword != NULL) &&
+            !(image->semstatus[index] & IMAGE_SEMAPHORE_STATUS_CONNECTED))
+    {
+        __atomic_fetch_or(&image->semstatus[index], IMAGE_SEMAPHORE_STATUS_CONNECTED,
+                          __ATOMIC_SEQ_CST);
+    }
+
+    return ImageStreamIO_futexsem_wait(&image->semfutex[index], wakeword, abstime,
+                                       trywait);
+}
+
+// broadcast mode: only post semaphores that have a reader
+static inline int ImageStreamIO_semconnected(
+    const IMAGE *image,
+    long index)
+{
+    return (image->semReadPID[index] > 0) ||
+           (image->semstatus[index] & IMAGE_SEMAPHORE_STATUS_CONNECTED);
+}
+
+
+
+/**
+ * ## Purpose
+ *
+ * Destroy semaphore of a shmim
+ *
+ * ## Arguments
+ *
+ * @param[in]
  * image	IMAGE*
  * 			pointer to shmim
  **/
@@ -1543,6 +3314,12 @@ errno_t ImageStreamIO_destroysem(
         initSHAREDMEMDIR = 1;
     }
 
+    // Futex semaphores are part of the stream, no files to remove
+    if ((image->md->sem > 0) && ImageStreamIO_usefutex(image))
+    {
+        image->md->sem = 0;
+    }
+
     // Remove semaphores if any
     if (image->md->sem > 0)
     {
@@ -1614,6 +3391,25 @@ int ImageStreamIO_createsem(
     // Remove pre-existing semaphores if any
     // ImageStreamIO_destroysem(image);
 
+    if (ImageStreamIO_usefutex(image))
+    {
+        // semaphores, semlog and broadcast generation are futex words in the stream
+        for (int s = 0; s < NBsem + 2; s++)
+        {
+            image->semfutex[s].value = SEMAPHORE_INITVAL;
+            image->semfutex[s].nwaiters = 0;
+        }
+        for (int s = 0; s < NBsem; s++)
+        {
+            image->semfile[s].fname[0] = '\0';
+            image->semfile[s].inode = 0;
+        }
+        image->semptr = NULL;
+        image->md->sem = NBsem;
+
+        return IMAGESTREAMIO_SUCCESS;
+    }
+
     // printf("malloc semptr %ld entries\n", NBsem);
     image->semptr = (sem_t **)malloc(sizeof(sem_t **) * NBsem);
     if (image->semptr == NULL)
@@ -1704,6 +3500,72 @@ long ImageStreamIO_sempost(
 
     writeProcessPID = getpid();
 
+    if (ImageStreamIO_usebroadcast(image))
+    {
+        // one generation bump and at most one wake call for all readers
+        if (index < 0)
+        {
+            for (long s = 0; s < image->md->sem; s++)
+            {
+                if (ImageStreamIO_semconnected(image, s))
+                {
+                    ImageStreamIO_futexsem_increment(&image->semfutex[s]);
+                    if (image->semWritePID[s] != writeProcessPID)
+                    {
+                        image->semWritePID[s] = writeProcessPID;
+                    }
+                }
+            }
+        }
+        else if (index > image->md->sem - 1)
+        {
+            printf("ERROR: image %s semaphore # %ld does no exist\n", image->md->name,
+                   index);
+        }
+        else
+        {
+            ImageStreamIO_futexsem_increment(&image->semfutex[index]);
+            image->semWritePID[index] = writeProcessPID;
+        }
+        ImageStreamIO_futexsem_broadcast(ImageStreamIO_futexwakeword(image));
+
+        // semlog
+        ImageStreamIO_futexsem_post(&image->semfutex[image->md->sem]);
+
+        return IMAGESTREAMIO_SUCCESS;
+    }
+
+    if (ImageStreamIO_usefutex(image))
+    {
+        if (index < 0)
+        {
+            for (long s = 0; s < image->md->sem; s++)
+            {
+                // avoid dirtying the line on every post
+                if (image->semWritePID[s] != writeProcessPID)
+                {
+                    image->semWritePID[s] = writeProcessPID;
+                }
+                ImageStreamIO_futexsem_post(&image->semfutex[s]);
+            }
+        }
+        else if (index > image->md->sem - 1)
+        {
+            printf("ERROR: image %s semaphore # %ld does no exist\n", image->md->name,
+                   index);
+        }
+        else
+        {
+            ImageStreamIO_futexsem_post(&image->semfutex[index]);
+            image->semWritePID[index] = writeProcessPID;
+        }
+
+        // semlog
+        ImageStreamIO_futexsem_post(&image->semfutex[image->md->sem]);
+
+        return IMAGESTREAMIO_SUCCESS;
+    }
+
     if (index < 0)
     {
         long s;
@@ -1714,10 +3576,15 @@ long ImageStreamIO_sempost(
 
             image->semWritePID[s] = writeProcessPID;
 
-            sem_getvalue(image->semptr[s], &semval);
+            sem_t *sem = ImageStreamIO_getsemptr(image, s);
+            if (sem == NULL)
+            {
+                continue;
+            }
+            sem_getvalue(sem, &semval);
             if (semval < SEMAPHORE_MAXVAL)
             {
-                sem_post(image->semptr[s]);
+                sem_post(sem);
             }
         }
     }
@@ -1729,24 +3596,30 @@ long ImageStreamIO_sempost(
         else
         {
             int semval;
+            sem_t *sem = ImageStreamIO_getsemptr(image, index);
 
-            sem_getvalue(image->semptr[index], &semval);
+            if (sem == NULL)
+            {
+                return IMAGESTREAMIO_SEMINIT;
+            }
+            sem_getvalue(sem, &semval);
             if (semval < SEMAPHORE_MAXVAL)
             {
-                sem_post(image->semptr[index]);
+                sem_post(sem);
                 image->semWritePID[index] = writeProcessPID;
             }
         }
     }
 
-    if (image->semlog != NULL)
+    sem_t *semlog = ImageStreamIO_getsemptr(image, image->md->sem);
+    if (semlog != NULL)
     {
         int semval;
 
-        sem_getvalue(image->semlog, &semval);
+        sem_getvalue(semlog, &semval);
         if (semval < SEMAPHORE_MAXVAL)
         {
-            sem_post(image->semlog);
+            sem_post(semlog);
         }
     }
 
@@ -1778,29 +3651,61 @@ long ImageStreamIO_sempost_excl(
 
     writeProcessPID = getpid();
 
-    for (s = 0; s < image->md->sem; s++)
+    if (ImageStreamIO_usefutex(image))
     {
-        if (s != index)
-        {
-            int semval;
+        SEMFUTEX *wakeword = ImageStreamIO_futexwakeword(image);
 
-            sem_getvalue(image->semptr[s], &semval);
-            if (semval < SEMAPHORE_MAXVAL)
+        for (s = 0; s < image->md->sem; s++)
+        {
+            if (s == index)
+            {
+                continue;
+            }
+            if (wakeword == NULL)
             {
-                sem_post(image->semptr[s]);
+                ImageStreamIO_futexsem_post(&image->semfutex[s]);
                 image->semWritePID[s] = writeProcessPID;
             }
+            else if (ImageStreamIO_semconnected(image, s))
+            {
+                ImageStreamIO_futexsem_increment(&image->semfutex[s]);
+                image->semWritePID[s] = writeProcessPID;
+            }
+        }
+        if (wakeword != NULL)
+        {
+            ImageStreamIO_futexsem_broadcast(wakeword);
         }
+        ImageStreamIO_futexsem_post(&image->semfutex[image->md->sem]);
+
+        return IMAGESTREAMIO_SUCCESS;
     }
 
-    if (image->semlog != NULL)
+    for (s = 0; s < image->md->sem; s++)
+    {
+        sem_t *sem;
+        if ((s != index) && ((sem = ImageStreamIO_getsemptr(image, s)) != NULL))
+        {
+            int semval;
+
+            sem_getvalue(sem, &semval);
+            if (semval < SEMAPHORE_MAXVAL)
+            {
+                sem_post(sem);
+                image->semWritePID[s] = writeProcessPID;
+            }
+        }
+    }
+
+    sem_t *semlog = ImageStreamIO_getsemptr(image, image->md->sem);
+    if (semlog != NULL)
     {
         int semval;
 
-        sem_getvalue(image->semlog, &semval);
+        sem_getvalue(semlog, &semval);
         if (semval < SEMAPHORE_MAXVAL)
         {
-            sem_post(image->semlog);
+            sem_post(semlog);
             image->semWritePID[index] = writeProcessPID;
         }
     }
@@ -1844,34 +3749,102 @@ long ImageStreamIO_sempost_loop(
     return IMAGESTREAMIO_SUCCESS;
 }
 
-/**
- * ## Purpose
- *
- * Get available shmim semaphore index
- *
- * ## Arguments
- *
- * @param[in]
- * image	IMAGE*
- * 			pointer to shmim
- *
- * @param[in]
- * index    preferred semaphore index, if available
- *
- */
-int ImageStreamIO_getsemwaitindex(
+// Reader slot leases
+// A reader holding a semaphore index renews semreader[index].lease (CLOCK_MONOTONIC)
+// when waiting on it. Held slots are only probed with getpgid once their
+// lease is older than IMAGE_SEMLEASE_NS.
+
+static inline uint64_t ImageStreamIO_leasetime(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + (uint64_t) t.tv_nsec;
+}
+
+// renew lease of slot index if held, rate limited to limit cache line traffic
+static inline void ImageStreamIO_renewlease(
+    IMAGE *image,
+    int index)
+{
+    if ((image->semreader == NULL) || (image->semReadPID[index] <= 0))
+    {
+        return;
+    }
+    uint64_t now = ImageStreamIO_leasetime();
+    if (now - __atomic_load_n(&image->semreader[index].lease, __ATOMIC_RELAXED) > IMAGE_SEMLEASE_NS / 8)
+    {
+        __atomic_store_n(&image->semreader[index].lease, now, __ATOMIC_RELAXED);
+    }
+}
+
+// Claim semindex for readProcessPID with compare-and-swap.
+// reclaim = 0: only free slots (semReadPID 0 or -1)
+// reclaim = 1: only slots with an expired lease whose reader is gone
+// returns 1 if claimed
+static int ImageStreamIO_claimsemindex(
+    IMAGE *image,
+    int semindex,
+    pid_t readProcessPID,
+    uint64_t now,
+    int reclaim)
+{
+    pid_t holder = __atomic_load_n(&image->semReadPID[semindex], __ATOMIC_ACQUIRE);
+
+    if (reclaim == 0)
+    {
+        if ((holder != 0) && (holder != -1))
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        if (holder <= 0)
+        {
+            return 0;
+        }
+        uint64_t lease = __atomic_load_n(&image->semreader[semindex].lease, __ATOMIC_RELAXED);
+        if (now - lease < IMAGE_SEMLEASE_NS)
+        {
+            return 0;
+        }
+        if (getpgid(holder) >= 0)
+        {
+            // reader alive but idle, do not probe it again for a while
+            __atomic_store_n(&image->semreader[semindex].lease, now, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+
+    if (!__atomic_compare_exchange_n(&image->semReadPID[semindex], &holder, readProcessPID,
+                                     0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+        // another reader was faster
+        return 0;
+    }
+    __atomic_store_n(&image->semreader[semindex].lease, now, __ATOMIC_RELAXED);
+    // not required by flow control until ImageStreamIO_flow_register
+    __atomic_fetch_and(&image->semstatus[semindex], ~IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED,
+                       __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+// claim semaphore index, see ImageStreamIO_getsemwaitindex
+static int ImageStreamIO_claimsemwaitindex(
     IMAGE *image,
     int semindexdefault)
 {
     pid_t readProcessPID;
 
     readProcessPID = getpid();
+    uint64_t now = ImageStreamIO_leasetime();
 
     // Attempt to find a semaphore already assigned to this PID
     for (int semindex = 0; semindex < image->md->sem; ++semindex)
     {
-        if (image->semReadPID[semindex] == readProcessPID)
+        if (__atomic_load_n(&image->semReadPID[semindex], __ATOMIC_ACQUIRE) == readProcessPID)
         {
+            __atomic_store_n(&image->semreader[semindex].lease, now, __ATOMIC_RELAXED);
             return semindex;
         }
     }
@@ -1879,24 +3852,28 @@ int ImageStreamIO_getsemwaitindex(
     // check that semindexdefault is within range
     if ((semindexdefault < image->md->sem) && (semindexdefault >= 0))
     {
-        // Check if semindexdefault available
-        if ((image->semReadPID[semindexdefault] == 0) ||
-                (getpgid(image->semReadPID[semindexdefault]) < 0))
+        // Check if semindexdefault available, free or held by a dead reader
+        if (ImageStreamIO_claimsemindex(image, semindexdefault, readProcessPID, now, 0) ||
+                ImageStreamIO_claimsemindex(image, semindexdefault, readProcessPID, now, 1))
         {
-            // if OK, then adopt it
-            image->semReadPID[semindexdefault] = readProcessPID;
             return semindexdefault;
         }
     }
 
     // if not, look for available semindex
+    for (int semindex = 0; semindex < image->md->sem; ++semindex)
+    {
+        if (ImageStreamIO_claimsemindex(image, semindex, readProcessPID, now, 0))
+        {
+            return semindex;
+        }
+    }
 
+    // then reclaim semindex from dead readers, only probing expired leases
     for (int semindex = 0; semindex < image->md->sem; ++semindex)
     {
-        if ((image->semReadPID[semindex] == 0) ||
-                (getpgid(image->semReadPID[semindex]) < 0))
+        if (ImageStreamIO_claimsemindex(image, semindex, readProcessPID, now, 1))
         {
-            image->semReadPID[semindex] = readProcessPID;
             return semindex;
         }
     }
@@ -1908,7 +3885,7 @@ int ImageStreamIO_getsemwaitindex(
 /**
  * ## Purpose
  *
- * Wait on a shmim semaphore
+ * Get available shmim semaphore index
  *
  * ## Arguments
  *
@@ -1917,53 +3894,111 @@ int ImageStreamIO_getsemwaitindex(
  * 			pointer to shmim
  *
  * @param[in]
- * index    semaphore index
+ * index    preferred semaphore index, if available
  *
- **/
-int ImageStreamIO_semwait(
+ */
+int ImageStreamIO_getsemwaitindex(
     IMAGE *image,
-    int index)
+    int semindexdefault)
 {
-    if (index > image->md->sem - 1)
+    int semindex = ImageStreamIO_claimsemwaitindex(image, semindexdefault);
+
+    if ((semindex >= 0) && !ImageStreamIO_usefutex(image))
     {
-        printf("ERROR: image %s semaphore # %d does not exist\n", image->md->name,
-               index);
-        return EXIT_FAILURE;
+        // attach semaphore now rather than on first wait
+        ImageStreamIO_getsemptr(image, semindex);
     }
-    return sem_wait(image->semptr[index]);
+    return semindex;
 }
 
-int ImageStreamIO_semtrywait(
+/**
+ * ## Purpose
+ *
+ * Release a semaphore index claimed with ImageStreamIO_getsemwaitindex
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * semindex semaphore index
+ *
+ **/
+errno_t ImageStreamIO_releasesemwaitindex(
     IMAGE *image,
-    int index)
+    int semindex)
+{
+    if ((semindex < 0) || (semindex > image->md->sem - 1))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG, "semaphore index out of range");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    pid_t readProcessPID = getpid();
+    if (!__atomic_compare_exchange_n(&image->semReadPID[semindex], &readProcessPID, 0, 0,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG, "semaphore index not held by process");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+    __atomic_store_n(&image->semreader[semindex].lease, 0, __ATOMIC_RELAXED);
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+// Writer flow control
+// Readers that must not lose frames set IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED
+// on their semaphore index and report consumed frames in semreader[].cnt0.
+// The writer may run ahead of the slowest of them by the number of frames
+// the stream holds, see ImageStreamIO_flowdepth.
+
+// frames held by stream before frame cnt0 - depth is overwritten
+static uint64_t ImageStreamIO_flowdepth(
+    const IMAGE *image)
 {
-    if (index > image->md->sem - 1)
+    if (image->md->CBsize > 0)
     {
-        printf("ERROR: image %s semaphore # %d does not exist\n", image->md->name,
-               index);
-        return EXIT_FAILURE;
+        return image->md->CBsize;
     }
-    return sem_trywait(image->semptr[index]);
+    if ((image->md->imagetype & 0xF000F) == (CIRCULAR_BUFFER | ZAXIS_TEMPORAL))
+    {
+        // latest slice is kept readable, see ImageStreamIO_reserveSlice
+        return image->md->size[2] - 1;
+    }
+    return 1;
 }
 
-int ImageStreamIO_semtimedwait(
-    IMAGE *image,
-    int index,
-    const struct timespec *semwts)
+// slowest required reader: returns its semaphore index, -1 if none
+static int ImageStreamIO_flowslowest(
+    const IMAGE *image,
+    uint64_t *consumed)
 {
-    if (index > image->md->sem - 1)
+    int slowest = -1;
+
+    for (int semindex = 0; semindex < image->md->sem; semindex++)
     {
-        printf("ERROR: image %s semaphore # %d does not exist\n", image->md->name,
-               index);
-        return EXIT_FAILURE;
+        if (!(__atomic_load_n(&image->semstatus[semindex], __ATOMIC_ACQUIRE) &
+                IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED) ||
+                (__atomic_load_n(&image->semReadPID[semindex], __ATOMIC_RELAXED) <= 0))
+        {
+            continue;
+        }
+        uint64_t cnt0 = __atomic_load_n(&image->semreader[semindex].cnt0, __ATOMIC_ACQUIRE);
+        if ((slowest == -1) || (cnt0 < *consumed))
+        {
+            slowest = semindex;
+            *consumed = cnt0;
+        }
     }
-    return sem_timedwait(image->semptr[index], semwts);
+    return slowest;
 }
 
 /**
  * ## Purpose
  *
- * Flush shmim semaphore
+ * Set writer flow control policy of stream
  *
  * ## Arguments
  *
@@ -1972,127 +4007,2402 @@ int ImageStreamIO_semtimedwait(
  * 			pointer to shmim
  *
  * @param[in]
- * index    semaphore index
- * 			flush all semaphores if index<0
+ * policy   IMAGE_FLOW_OVERWRITE, IMAGE_FLOW_BLOCK or IMAGE_FLOW_DROP
  *
  **/
-long ImageStreamIO_semflush(
+errno_t ImageStreamIO_set_flowpolicy(
     IMAGE *image,
-    long index)
+    uint8_t policy)
 {
-    if (index < 0)
+    if ((policy != IMAGE_FLOW_OVERWRITE) && (policy != IMAGE_FLOW_BLOCK) &&
+            (policy != IMAGE_FLOW_DROP))
     {
-        long s;
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG, "invalid flow policy");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+    if ((policy != IMAGE_FLOW_OVERWRITE) && (image->semreader == NULL))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "flow control needs a shared stream");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+    __atomic_store_n(&image->md->flowpolicy, policy, __ATOMIC_RELEASE);
 
-        for (s = 0; s < image->md->sem; s++)
-        {
-            int semval;
-            int i;
+    return IMAGESTREAMIO_SUCCESS;
+}
 
-            sem_getvalue(image->semptr[s], &semval);
-            for (i = 0; i < semval; i++)
-            {
-                sem_trywait(image->semptr[s]);
-            }
-        }
+/**
+ * ## Purpose
+ *
+ * Declare reader holding semaphore index as required (or not) by writer
+ * flow control
+ *
+ * Consumed position is set to the current frame.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * semindex semaphore index, from ImageStreamIO_getsemwaitindex
+ *
+ * @param[in]
+ * required 1 if reader must not lose frames, 0 otherwise
+ *
+ **/
+errno_t ImageStreamIO_flow_register(
+    IMAGE *image,
+    int semindex,
+    int required)
+{
+    if ((image->semreader == NULL) || (semindex < 0) ||
+            (semindex > image->md->sem - 1))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "semaphore index out of range, or stream not shared");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    __atomic_store_n(&image->semreader[semindex].cnt0,
+                     __atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    if (required)
+    {
+        __atomic_fetch_or(&image->semstatus[semindex], IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED,
+                          __ATOMIC_SEQ_CST);
     }
     else
     {
-        if (index > image->md->sem - 1)
-            printf("ERROR: image %s semaphore # %ld does not exist\n",
-                   image->md->name, index);
-        else
-        {
-            long s;
-            int semval;
-            int i;
-
-            s = index;
-            sem_getvalue(image->semptr[s], &semval);
-            for (i = 0; i < semval; i++)
-            {
-                sem_trywait(image->semptr[s]);
-            }
-        }
+        __atomic_fetch_and(&image->semstatus[semindex], ~IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED,
+                           __ATOMIC_SEQ_CST);
     }
 
     return IMAGESTREAMIO_SUCCESS;
 }
 
-long ImageStreamIO_semvalue(
+/**
+ * ## Purpose
+ *
+ * Report frames consumed by reader holding semaphore index
+ *
+ * Frames up to cnt0 may be overwritten by the writer.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * semindex semaphore index
+ *
+ * @param[in]
+ * cnt0     cnt0 of last frame consumed
+ *
+ **/
+errno_t ImageStreamIO_flow_consumed(
     IMAGE *image,
-    long index)
+    int semindex,
+    uint64_t cnt0)
 {
-    if(index > image->md->sem - 1)
-        printf("ERROR: image %s semaphore # %ld does not exist\n",
-               image->md->name, index);
-    else
+    if ((image->semreader == NULL) || (semindex < 0) ||
+            (semindex > image->md->sem - 1))
     {
-        int semval;
-        sem_getvalue(image->semptr[index], &semval);
-        return semval;
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "semaphore index out of range, or stream not shared");
+        return IMAGESTREAMIO_INVALIDARG;
     }
-    return -1; // in-band error bad
+
+    // frame data loads done before writer may reuse the slot
+    __atomic_store_n(&image->semreader[semindex].cnt0, cnt0, __ATOMIC_RELEASE);
+    ImageStreamIO_renewlease(image, semindex);
+
+    return IMAGESTREAMIO_SUCCESS;
 }
 
-// Function to be called each time image content is updated
-// Increments counter, sets write flag to zero etc...
-long ImageStreamIO_UpdateIm(
+/**
+ * ## Purpose
+ *
+ * Apply stream flow policy before writing next frame
+ *
+ * To be called by the writer before ImageStreamIO_BeginUpdateIm (or
+ * before writing the next slice). Returns IMAGESTREAMIO_SUCCESS if the
+ * frame can be written. If the next frame would overwrite a frame not yet
+ * consumed by a required reader:
+ * - IMAGE_FLOW_OVERWRITE: returns IMAGESTREAMIO_SUCCESS
+ * - IMAGE_FLOW_BLOCK: waits until the reader catches up. Readers gone
+ *   without releasing their semaphore index stop being waited for once
+ *   their lease expires
+ * - IMAGE_FLOW_DROP: increments md->flowdropcnt and returns
+ *   IMAGESTREAMIO_FAILURE with errno ENOBUFS, the frame should be skipped
+ *
+ * On temporal circular buffers written with ImageStreamIO_reserveSlice,
+ * call it before reserving: the next frame is the one of the next ticket.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ **/
+errno_t ImageStreamIO_flowcontrol(
     IMAGE *image)
 {
-    if (image->md->shared == 1)
+    uint8_t policy = __atomic_load_n(&image->md->flowpolicy, __ATOMIC_ACQUIRE);
+    if ((policy == IMAGE_FLOW_OVERWRITE) || (image->semreader == NULL))
     {
+        return IMAGESTREAMIO_SUCCESS;
+    }
 
-        // update circular buffer if applicable
-        if (image->md->CBsize > 0)
+    uint64_t depth = ImageStreamIO_flowdepth(image);
+    uint64_t cnt0next = __atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE);
+    if ((image->md->imagetype & 0xF000F) == (CIRCULAR_BUFFER | ZAXIS_TEMPORAL))
+    {
+        // slices reserved but not yet published are ahead of cnt0
+        uint64_t ticket = __atomic_load_n(&image->md->CBticket, __ATOMIC_ACQUIRE);
+        if (ticket > cnt0next)
         {
-            // write index
-            uint32_t CBindexWrite = image->md->CBindex + 1;
-            int CBcycleincrement = 0;
-            if (CBindexWrite >= image->md->CBsize)
-            {
-                CBindexWrite = 0;
-                CBcycleincrement = 1;
-            }
-            // destination pointer
-            void *destptr;
-            destptr = ((uint8_t*)image->CBimdata) +
-                      (image->md->imdatamemsize * CBindexWrite);
-
-            memcpy(destptr, image->array.raw,
-                   image->md->imdatamemsize);
-
-            image->md->CBcycle += CBcycleincrement;
-            image->md->CBindex = CBindexWrite;
+            cnt0next = ticket;
         }
+    }
+    cnt0next++;
 
-        image->md->cnt0++;
-        image->md->write = 0;
+    for (;;)
+    {
+        uint64_t consumed = 0;
+        int slowest = ImageStreamIO_flowslowest(image, &consumed);
+        if ((slowest == -1) || (consumed + depth >= cnt0next))
+        {
+            return IMAGESTREAMIO_SUCCESS;
+        }
 
-#ifdef IMAGESTRUCT_WRITEHISTORY
-        // Update image write history
-        image->md->wCBindex ++;
-        if( image->md->wCBindex == IMAGESTRUCT_FRAMEWRITEMDSIZE )
+        if (policy == IMAGE_FLOW_DROP)
         {
-            image->md->wCBindex = 0;
+            __atomic_add_fetch(&image->md->flowdropcnt, 1, __ATOMIC_RELAXED);
+            errno = ENOBUFS;
+            return IMAGESTREAMIO_FAILURE;
         }
+
+        // IMAGE_FLOW_BLOCK
+        pid_t holder = __atomic_load_n(&image->semReadPID[slowest], __ATOMIC_RELAXED);
+        uint64_t lease = __atomic_load_n(&image->semreader[slowest].lease, __ATOMIC_RELAXED);
+        if ((ImageStreamIO_leasetime() - lease > IMAGE_SEMLEASE_NS) &&
+                (getpgid(holder) < 0))
         {
-            struct timespec ts;
-            if(clock_gettime(CLOCK_ISIO, &ts) == -1)
-            {
-                perror("clock_gettime");
-                exit(EXIT_FAILURE);
-            }
+            // reader died, stop waiting for it
+            __atomic_fetch_and(&image->semstatus[slowest], ~IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED,
+                               __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        struct timespec poll = { 0, IMAGE_FLOW_POLL_NS };
+        nanosleep(&poll, NULL);
+    }
+}
+
+static int ImageStreamIO_timespec_passed(
+    const struct timespec *semwts)
+{
+    struct timespec tnow;
+    clock_gettime(CLOCK_REALTIME, &tnow);
+    return (tnow.tv_sec > semwts->tv_sec) ||
+           ((tnow.tv_sec == semwts->tv_sec) && (tnow.tv_nsec >= semwts->tv_nsec));
+}
+
+// Reconnect (IMAGE_SEMAPHORE_CONTROL_READY)
+// Waits check READY of their semaphore before and after waiting. While it
+// is cleared they poll every IMAGE_RECONNECT_POLL_NS, until the writer sets
+// it again (pause) or the stream file is replaced (destroyed and created
+// again), in which case the IMAGE is remapped and the wait returns ESTALE.
+
+#define IMAGESTREAMIO_STREAMFILE_MAPPED   0  // stream file is the one mapped
+#define IMAGESTREAMIO_STREAMFILE_REMOVED  1  // mapped file unlinked, no stream file
+#define IMAGESTREAMIO_STREAMFILE_REPLACED 2  // stream file is another file
+
+static int ImageStreamIO_streamfile(
+    const IMAGE *image,
+    char *fname,
+    size_t fnamesize)
+{
+    struct stat file_stat;
+    struct stat map_stat;
+
+    if ((image->memsize == 0) || (image->md->shared != 1))
+    {
+        return IMAGESTREAMIO_STREAMFILE_MAPPED;
+    }
+
+    ImageStreamIO_filename(fname, fnamesize, image->name);
+    int exists = (stat(fname, &file_stat) == 0);
+    if (fstat(image->shmfd, &map_stat) == 0)
+    {
+        // inode numbers can be recycled once the mapped file is unlinked
+        if ((map_stat.st_nlink > 0) && exists && (map_stat.st_ino == file_stat.st_ino))
+        {
+            return IMAGESTREAMIO_STREAMFILE_MAPPED;
+        }
+    }
+    else if (exists && (image->md->inode == file_stat.st_ino))
+    {
+        return IMAGESTREAMIO_STREAMFILE_MAPPED;
+    }
+
+    return exists ? IMAGESTREAMIO_STREAMFILE_REPLACED : IMAGESTREAMIO_STREAMFILE_REMOVED;
+}
+
+errno_t ImageStreamIO_reconnect(
+    IMAGE *image)
+{
+    char fname[STRINGMAXLEN_FILE_NAME];
+
+    if (ImageStreamIO_streamfile(image, fname, sizeof(fname)) != IMAGESTREAMIO_STREAMFILE_REPLACED)
+    {
+        errno = EAGAIN;
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    // new stream is ready once its semaphores are
+    IMAGE newimage;
+    if (!ImageStreamIO_versionmatch(fname) ||
+            (ImageStreamIO_openIm_map(&newimage, image->name, IMAGE_OPEN_LAZYSEM) != IMAGESTREAMIO_SUCCESS))
+    {
+        errno = EAGAIN;
+        return IMAGESTREAMIO_FAILURE;
+    }
+    if ((newimage.md->sem > 0) &&
+            !(__atomic_load_n(&newimage.semctrl[0], __ATOMIC_ACQUIRE) & IMAGE_SEMAPHORE_CONTROL_READY))
+    {
+        ImageStreamIO_closeIm(&newimage);
+        errno = EAGAIN;
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    // keep semaphore indices held by this process, and their flow control
+    // registration, consumed from the new stream's first frame on
+    pid_t pid = getpid();
+    uint64_t now = ImageStreamIO_leasetime();
+    for (int semindex = 0; semindex < newimage.md->sem; semindex++)
+    {
+        if ((semindex < image->semmapped) &&
+                (__atomic_load_n(&image->semReadPID[semindex], __ATOMIC_ACQUIRE) == pid) &&
+                ImageStreamIO_claimsemindex(&newimage, semindex, pid, now, 0))
+        {
+            __atomic_store_n(&newimage.semreader[semindex].cnt0,
+                             __atomic_load_n(&newimage.md->cnt0, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+            if (__atomic_load_n(&image->semstatus[semindex], __ATOMIC_ACQUIRE) &
+                    IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED)
+            {
+                __atomic_fetch_or(&newimage.semstatus[semindex], IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED,
+                                  __ATOMIC_SEQ_CST);
+            }
+        }
+    }
+
+    newimage.used = image->used;
+    newimage.copythreads = image->copythreads;
+    newimage.copyminsize = image->copyminsize;
+    ImageStreamIO_closeIm(image);
+    *image = newimage;
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+// wait for semaphore index to be ready, see ImageStreamIO_reconnect
+// returns 0 if ready, -1 with errno ESTALE (remapped), EAGAIN (trywait) or ETIMEDOUT
+static int ImageStreamIO_semready(
+    IMAGE *image,
+    int index,
+    const struct timespec *semwts,
+    int trywait)
+{
+    if (image->md->shared != 1)
+    {
+        return 0;
+    }
+
+    // destroyed streams have no semaphore left
+    while ((index >= image->md->sem) ||
+            !(__atomic_load_n(&image->semctrl[index], __ATOMIC_ACQUIRE) & IMAGE_SEMAPHORE_CONTROL_READY))
+    {
+        if (ImageStreamIO_reconnect(image) == IMAGESTREAMIO_SUCCESS)
+        {
+            errno = ESTALE;
+            return -1;
+        }
+        if (trywait)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        if ((semwts != NULL) && ImageStreamIO_timespec_passed(semwts))
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        struct timespec tpoll = {0, IMAGE_RECONNECT_POLL_NS};
+        nanosleep(&tpoll, NULL);
+    }
+    return 0;
+}
+
+// check semaphore index, waiting for stream to be re-created if it was destroyed
+static int ImageStreamIO_semrange(
+    IMAGE *image,
+    int index,
+    const struct timespec *semwts,
+    int trywait)
+{
+    char fname[STRINGMAXLEN_FILE_NAME];
+
+    if ((index >= 0) && (index < image->md->sem))
+    {
+        return 0;
+    }
+    if ((index >= 0) &&
+            (ImageStreamIO_streamfile(image, fname, sizeof(fname)) != IMAGESTREAMIO_STREAMFILE_MAPPED))
+    {
+        return ImageStreamIO_semready(image, index, semwts, trywait);
+    }
+    printf("ERROR: image %s semaphore # %d does not exist\n", image->md->name,
+           index);
+    return EXIT_FAILURE;
+}
+
+// semwait, semtrywait (trywait = 1) and semtimedwait (semwts != NULL)
+static int ImageStreamIO_semwait_ready(
+    IMAGE *image,
+    int index,
+    const struct timespec *semwts,
+    int trywait)
+{
+    int rv = ImageStreamIO_semrange(image, index, semwts, trywait);
+    if (rv != 0)
+    {
+        return rv;
+    }
+    ImageStreamIO_renewlease(image, index);
+    if (ImageStreamIO_semready(image, index, semwts, trywait) != 0)
+    {
+        return -1;
+    }
+
+    if (ImageStreamIO_usefutex(image))
+    {
+        rv = ImageStreamIO_futexsem_waitindex(image, index, semwts, trywait);
+    }
+    else
+    {
+        sem_t *sem = ImageStreamIO_getsemptr(image, index);
+        if (sem == NULL)
+        {
+            return -1;
+        }
+        if (trywait)
+        {
+            rv = sem_trywait(sem);
+        }
+        else if (semwts != NULL)
+        {
+            rv = sem_timedwait(sem, semwts);
+        }
+        else
+        {
+            rv = sem_wait(sem);
+        }
+    }
+
+    // woken up by stream teardown
+    if ((rv == 0) && (ImageStreamIO_semready(image, index, semwts, trywait) != 0))
+    {
+        return -1;
+    }
+    return rv;
+}
+
+/**
+ * ## Purpose
+ *
+ * Wait on a shmim semaphore
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * index    semaphore index
+ *
+ **/
+int ImageStreamIO_semwait(
+    IMAGE *image,
+    int index)
+{
+    return ImageStreamIO_semwait_ready(image, index, NULL, 0);
+}
+
+int ImageStreamIO_semtrywait(
+    IMAGE *image,
+    int index)
+{
+    return ImageStreamIO_semwait_ready(image, index, NULL, 1);
+}
+
+int ImageStreamIO_semtimedwait(
+    IMAGE *image,
+    int index,
+    const struct timespec *semwts)
+{
+    return ImageStreamIO_semwait_ready(image, index, semwts, 0);
+}
+
+// Spin-wait helpers for ImageStreamIO_semspinwait
+// umonitor/umwait (WAITPKG) is used when the CPU supports it,
+// pause otherwise.
+
+#if defined(__x86_64__) || defined(__i386__)
+static int ImageStreamIO_haswaitpkg(void)
+{
+    static int haswaitpkg = -1;
+    if (haswaitpkg < 0)
+    {
+        unsigned int eax, ebx, ecx, edx;
+        haswaitpkg = 0;
+        if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        {
+            haswaitpkg = (ecx >> 5) & 1;
+        }
+    }
+    return haswaitpkg;
+}
+
+__attribute__((target("waitpkg")))
+static void ImageStreamIO_umwait(
+    volatile uint64_t *addr,
+    uint64_t value)
+{
+    _umonitor((void *)addr);
+    if (*addr == value)
+    {
+        // C0.1 state, wake up within ~1us if the line is not written
+        _umwait(1, __rdtsc() + 2000);
+    }
+}
+#endif
+
+static inline void ImageStreamIO_spinwait_cnt0(
+    volatile uint64_t *addr,
+    uint64_t value)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (ImageStreamIO_haswaitpkg())
+    {
+        ImageStreamIO_umwait(addr, value);
+    }
+    else
+    {
+        _mm_pause();
+    }
+#elif defined(__aarch64__)
+    (void) addr;
+    (void) value;
+    __asm__ __volatile__("yield");
+#else
+    (void) addr;
+    (void) value;
+#endif
+}
+
+/**
+ * ## Purpose
+ *
+ * Wait on a shmim semaphore, spinning on md->cnt0 for up to spinns
+ * nanoseconds before blocking on the semaphore
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * index    semaphore index
+ *
+ * @param[in]
+ * spinns   spin budget [ns], 0 to block right away
+ *
+ * @param[in]
+ * semwts   absolute timeout (CLOCK_REALTIME) for blocking wait, NULL to wait forever
+ *
+ * @param[out]
+ * wakemode IMAGE_SEMWAIT_SPIN or IMAGE_SEMWAIT_BLOCK, may be NULL
+ *
+ **/
+int ImageStreamIO_semspinwait(
+    IMAGE *image,
+    int index,
+    long spinns,
+    const struct timespec *semwts,
+    int *wakemode)
+{
+    int rv = ImageStreamIO_semrange(image, index, semwts, 0);
+    if (rv != 0)
+    {
+        // also -1 with ESTALE if remapped onto re-created stream
+        return rv;
+    }
+
+    if (wakemode != NULL)
+    {
+        *wakemode = IMAGE_SEMWAIT_SPIN;
+    }
+
+    if ((rv = ImageStreamIO_semtrywait(image, index)) == 0)
+    {
+        return 0;
+    }
+    if ((rv == -1) && (errno == ESTALE))
+    {
+        // remapped, md is not the one spun on below
+        return -1;
+    }
+
+    if (spinns > 0)
+    {
+        volatile uint64_t *cnt0ptr = &image->md->cnt0;
+        uint64_t cnt0 = __atomic_load_n(cnt0ptr, __ATOMIC_ACQUIRE);
+        int pending = 0;
+        long iter = 0;
+
+        struct timespec tstart;
+        struct timespec tnow;
+        clock_gettime(CLOCK_MONOTONIC, &tstart);
+
+        for (;;)
+        {
+            ImageStreamIO_spinwait_cnt0(cnt0ptr, cnt0);
+
+            uint64_t cnt0now = __atomic_load_n(cnt0ptr, __ATOMIC_ACQUIRE);
+            if (cnt0now != cnt0)
+            {
+                // counter is updated before semaphores are posted
+                cnt0 = cnt0now;
+                pending = 1;
+            }
+
+            // also poll now and then, for writers posting without cnt0 update
+            if (pending || ((++iter & 0x3F) == 0))
+            {
+                if ((rv = ImageStreamIO_semtrywait(image, index)) == 0)
+                {
+                    return 0;
+                }
+                if ((rv == -1) && (errno == ESTALE))
+                {
+                    // old mapping, cnt0ptr included, is gone
+                    return -1;
+                }
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &tnow);
+            if ((tnow.tv_sec - tstart.tv_sec) * 1000000000L +
+                    (tnow.tv_nsec - tstart.tv_nsec) > spinns)
+            {
+                break;
+            }
+        }
+    }
+
+    if (wakemode != NULL)
+    {
+        *wakemode = IMAGE_SEMWAIT_BLOCK;
+    }
+
+    if (semwts != NULL)
+    {
+        return ImageStreamIO_semtimedwait(image, index, semwts);
+    }
+    return ImageStreamIO_semwait(image, index);
+}
+
+// Wait-for-any helpers for ImageStreamIO_semwait_any
+// futex_waitv (Linux >= 5.16) when all streams use futex semaphores,
+// polling with backoff otherwise.
+
+#ifndef SYS_futex_waitv
+#define SYS_futex_waitv 449
+#endif
+
+#define IMAGESTREAMIO_FUTEX_32          2
+#define IMAGESTREAMIO_FUTEX_WAITV_MAX 128
+
+// struct futex_waitv, kept local for older kernel headers
+typedef struct
+{
+    uint64_t val;
+    uint64_t uaddr;
+    uint32_t flags;
+    uint32_t reserved;
+} IMAGESTREAMIO_FUTEXWAITV;
+
+static int ImageStreamIO_hasfutexwaitv = 1;
+
+// sleep word and expected value for a futex semaphore
+static inline SEMFUTEX *ImageStreamIO_futexsleepword(
+    IMAGE *image,
+    int index,
+    uint32_t *expected)
+{
+    SEMFUTEX *wakeword = ImageStreamIO_futexwakeword(image);
+    if (wakeword != NULL)
+    {
+        *expected = __atomic_load_n(&wakeword->value, __ATOMIC_SEQ_CST);
+        return wakeword;
+    }
+    *expected = 0;
+    return &image->semfutex[index];
+}
+
+// consume every semaphore that is posted, returns number fired
+// stops at first stream remapped by ImageStreamIO_reconnect: fired[i] = -1,
+// returns -1 with errno ESTALE
+static int ImageStreamIO_semtrywait_any(
+    IMAGE **images,
+    int *semindex,
+    int n,
+    int *fired)
+{
+    int nfired = 0;
+    for (int i = 0; i < n; i++)
+    {
+        fired[i] = 0;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int rv = ImageStreamIO_semtrywait(images[i], semindex[i]);
+        if (rv == 0)
+        {
+            fired[i] = 1;
+            nfired++;
+        }
+        else if ((rv == -1) && (errno == ESTALE))
+        {
+            fired[i] = -1;
+            return -1;
+        }
+    }
+    return nfired;
+}
+
+// stream remapped by ImageStreamIO_semtrywait_any, NULL if none
+static IMAGE *ImageStreamIO_staleimage(
+    IMAGE **images,
+    int n,
+    const int *fired)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (fired[i] == -1)
+        {
+            return images[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * ## Purpose
+ *
+ * Wait on semaphores of several shmims, return when at least one is posted
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * images	IMAGE**
+ * 			array of n pointers to shmim
+ *
+ * @param[in]
+ * semindex semaphore index for each shmim
+ *
+ * @param[in]
+ * n        number of shmims
+ *
+ * @param[in]
+ * semwts   absolute timeout (CLOCK_REALTIME), NULL to wait forever
+ *
+ * @param[out]
+ * fired    array of n flags, set to 1 for each semaphore consumed
+ *
+ **/
+int ImageStreamIO_semwait_any(
+    IMAGE **images,
+    int *semindex,
+    int n,
+    const struct timespec *semwts,
+    int *fired)
+{
+    if (n < 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int usewaitv = (n <= IMAGESTREAMIO_FUTEX_WAITV_MAX);
+    for (int i = 0; i < n; i++)
+    {
+        if (semindex[i] < 0 || semindex[i] > images[i]->md->sem - 1)
+        {
+            printf("ERROR: image %s semaphore # %d does not exist\n",
+                   images[i]->md->name, semindex[i]);
+            errno = EINVAL;
+            return -1;
+        }
+        if (!ImageStreamIO_usefutex(images[i]))
+        {
+            usewaitv = 0;
+        }
+    }
+
+    if (usewaitv)
+    {
+        IMAGESTREAMIO_FUTEXWAITV waiters[IMAGESTREAMIO_FUTEX_WAITV_MAX];
+        SEMFUTEX *sleepwords[IMAGESTREAMIO_FUTEX_WAITV_MAX];
+
+        while (__atomic_load_n(&ImageStreamIO_hasfutexwaitv, __ATOMIC_RELAXED))
+        {
+            // paused or torn down stream: poll, semtrywait reconnects
+            int notready = 0;
+            for (int i = 0; i < n; i++)
+            {
+                if ((images[i]->md->sem > semindex[i]) &&
+                        !(__atomic_load_n(&images[i]->semctrl[semindex[i]], __ATOMIC_ACQUIRE) &
+                          IMAGE_SEMAPHORE_CONTROL_READY))
+                {
+                    notready = 1;
+                }
+            }
+            if (notready)
+            {
+                break;
+            }
+
+            // register as waiter before the last check, as in ImageStreamIO_futexsem_wait
+            for (int i = 0; i < n; i++)
+            {
+                uint32_t expected;
+                sleepwords[i] = ImageStreamIO_futexsleepword(images[i], semindex[i], &expected);
+                waiters[i].val = expected;
+                waiters[i].uaddr = (uint64_t)(uintptr_t) &sleepwords[i]->value;
+                waiters[i].flags = IMAGESTREAMIO_FUTEX_32;
+                waiters[i].reserved = 0;
+                __atomic_fetch_add(&sleepwords[i]->nwaiters, 1, __ATOMIC_SEQ_CST);
+            }
+
+            int nfired = ImageStreamIO_semtrywait_any(images, semindex, n, fired);
+            int err = errno;
+
+            long rv = 0;
+            if (nfired == 0)
+            {
+                rv = syscall(SYS_futex_waitv, waiters, n, 0, semwts, CLOCK_REALTIME);
+                err = errno;
+            }
+
+            // sleep words of a remapped stream were unmapped with it
+            IMAGE *staleimage = (nfired < 0) ? ImageStreamIO_staleimage(images, n, fired) : NULL;
+            for (int i = 0; i < n; i++)
+            {
+                if (images[i] != staleimage)
+                {
+                    __atomic_fetch_sub(&sleepwords[i]->nwaiters, 1, __ATOMIC_SEQ_CST);
+                }
+            }
+
+            if (nfired != 0)
+            {
+                errno = err;
+                return nfired;
+            }
+            if (rv == -1)
+            {
+                if (err == ENOSYS)
+                {
+                    // old kernel, poll from now on
+                    __atomic_store_n(&ImageStreamIO_hasfutexwaitv, 0, __ATOMIC_RELAXED);
+                }
+                else if ((err == ETIMEDOUT) || (err == EINTR) || (err == EINVAL))
+                {
+                    errno = err;
+                    return -1;
+                }
+            }
+            // woken up or a word changed (EAGAIN): check again
+        }
+    }
+
+    // polling fallback, backoff from 1 us to 1 ms
+    long pollns = 1000;
+    for (;;)
+    {
+        int nfired = ImageStreamIO_semtrywait_any(images, semindex, n, fired);
+        if (nfired != 0)
+        {
+            // also -1 with ESTALE
+            return nfired;
+        }
+        if ((semwts != NULL) && ImageStreamIO_timespec_passed(semwts))
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        struct timespec tpoll = {0, pollns};
+        nanosleep(&tpoll, NULL);
+        if (pollns < 1000000)
+        {
+            pollns *= 2;
+        }
+    }
+}
+
+/**
+ * ## Purpose
+ *
+ * Flush shmim semaphore
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * index    semaphore index
+ * 			flush all semaphores if index<0
+ *
+ **/
+long ImageStreamIO_semflush(
+    IMAGE *image,
+    long index)
+{
+    if (ImageStreamIO_usefutex(image))
+    {
+        if (index < 0)
+        {
+            for (long s = 0; s < image->md->sem; s++)
+            {
+                __atomic_store_n(&image->semfutex[s].value, 0, __ATOMIC_RELAXED);
+            }
+        }
+        else if (index > image->md->sem - 1)
+        {
+            printf("ERROR: image %s semaphore # %ld does not exist\n",
+                   image->md->name, index);
+        }
+        else
+        {
+            __atomic_store_n(&image->semfutex[index].value, 0, __ATOMIC_RELAXED);
+        }
+        return IMAGESTREAMIO_SUCCESS;
+    }
+
+    if (index < 0)
+    {
+        long s;
+
+        for (s = 0; s < image->md->sem; s++)
+        {
+            int semval;
+            int i;
+            sem_t *sem = ImageStreamIO_getsemptr(image, s);
+
+            if (sem == NULL)
+            {
+                continue;
+            }
+            sem_getvalue(sem, &semval);
+            for (i = 0; i < semval; i++)
+            {
+                sem_trywait(sem);
+            }
+        }
+    }
+    else
+    {
+        if (index > image->md->sem - 1)
+            printf("ERROR: image %s semaphore # %ld does not exist\n",
+                   image->md->name, index);
+        else
+        {
+            long s;
+            int semval;
+            int i;
+
+            s = index;
+            sem_t *sem = ImageStreamIO_getsemptr(image, s);
+            if (sem == NULL)
+            {
+                return IMAGESTREAMIO_SEMINIT;
+            }
+            sem_getvalue(sem, &semval);
+            for (i = 0; i < semval; i++)
+            {
+                sem_trywait(sem);
+            }
+        }
+    }
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+long ImageStreamIO_semvalue(
+    IMAGE *image,
+    long index)
+{
+    if(index > image->md->sem - 1)
+        printf("ERROR: image %s semaphore # %ld does not exist\n",
+               image->md->name, index);
+    else if (ImageStreamIO_usefutex(image))
+    {
+        return __atomic_load_n(&image->semfutex[index].value, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        int semval;
+        sem_t *sem = ImageStreamIO_getsemptr(image, index);
+        if (sem == NULL)
+        {
+            return -1;
+        }
+        sem_getvalue(sem, &semval);
+        return semval;
+    }
+    return -1; // in-band error bad
+}
+
+// Function to be called before image content is updated
+// Sets write flag, ordered before the frame data stores
+long ImageStreamIO_BeginUpdateIm(
+    IMAGE *image)
+{
+    __atomic_store_n(&image->md->write, 1, __ATOMIC_RELAXED);
+
+    if (image->cntarray != NULL)
+    {
+        // temporal circular buffer: slice about to be rewritten no longer
+        // holds its previous frame, see ImageStreamIO_commitSlice
+        uint32_t slice = (image->md->cnt1 + 1) % image->md->size[2];
+        __atomic_store_n(&image->cntarray[slice], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+// copy frame in array into next CB slot, stamped with cnt0
+// slot is only valid once its copy is complete
+static void ImageStreamIO_CBcopyframe(
+    IMAGE *image,
+    uint64_t cnt0)
+{
+    // write index
+    uint32_t CBindexWrite = image->md->CBindex + 1;
+    int CBcycleincrement = 0;
+    if (CBindexWrite >= image->md->CBsize)
+    {
+        CBindexWrite = 0;
+        CBcycleincrement = 1;
+    }
+    // destination pointer
+    void *destptr;
+    destptr = ((uint8_t*)image->CBimdata) +
+              (image->md->imdatamemsize * CBindexWrite);
+
+    ImageStreamIO_CBslot_invalidate(image, CBindexWrite);
+    ImageStreamIO_copyframe(image, destptr, image->array.raw,
+                            image->md->imdatamemsize);
+    ImageStreamIO_CBslot_stamp(image, CBindexWrite, cnt0);
+
+    image->md->CBcycle += CBcycleincrement;
+    __atomic_store_n(&image->md->CBindex, CBindexWrite, __ATOMIC_RELEASE);
+}
+
+// Function to be called each time image content is updated
+// Increments counter, sets write flag to zero etc...
+// With IMAGE_OPT_CBDEFERRED, the CB copy is done after semaphores are
+// posted: readers are woken without waiting for it, and the frame is in
+// the CB (ImageStreamIO_CB_get) once UpdateIm returns.
+long ImageStreamIO_UpdateIm(
+    IMAGE *image)
+{
+    if (image->md->shared == 1)
+    {
+        int CBdeferred = (image->md->CBsize > 0) &&
+                         (image->md->imagetype & IMAGE_OPT_CBDEFERRED) &&
+                         !(image->md->imagetype & IMAGE_OPT_CBZEROCOPY);
+
+        // update circular buffer if applicable
+        if (CBdeferred)
+        {
+            // after publish, below
+        }
+        else if (image->md->imagetype & IMAGE_OPT_CBZEROCOPY)
+        {
+            // frame was written in place into the slot after CBindex:
+            // publish that slot, no copy
+            uint32_t CBindexWrite = image->md->CBindex + 1;
+            if (CBindexWrite >= image->md->CBsize)
+            {
+                CBindexWrite = 0;
+                image->md->CBcycle++;
+            }
+            ImageStreamIO_CBslot_stamp(image, CBindexWrite, image->md->cnt0 + 1);
+            __atomic_store_n(&image->md->CBindex, CBindexWrite, __ATOMIC_RELEASE);
+
+            // next frame goes into the following slot, which leaves the history
+            uint32_t CBindexNext = (CBindexWrite + 1) % image->md->CBsize;
+            ImageStreamIO_CBslot_invalidate(image, CBindexNext);
+            image->array.raw = ImageStreamIO_CBslotptr(image, CBindexNext);
+        }
+        else if (image->md->CBsize > 0)
+        {
+            ImageStreamIO_CBcopyframe(image, image->md->cnt0 + 1);
+        }
+
+        // publish: frame data before cnt0, cnt0 before clearing write flag
+        // pairs with the acquire side of ImageStreamIO_read_consistent
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&image->md->cnt0, image->md->cnt0 + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&image->md->write, 0, __ATOMIC_RELEASE);
+
+#ifdef IMAGESTRUCT_WRITEHISTORY
+        // Update image write history
+        image->md->wCBindex ++;
+        if( image->md->wCBindex == IMAGESTRUCT_FRAMEWRITEMDSIZE )
+        {
+            image->md->wCBindex = 0;
+        }
+        {
+            struct timespec ts;
+            if(clock_gettime(CLOCK_ISIO, &ts) == -1)
+            {
+                perror("clock_gettime");
+                exit(EXIT_FAILURE);
+            }
             image->writehist[image->md->wCBindex].writetime = ts;
             image->writehist[image->md->wCBindex].cnt0 = image->md->cnt0;
             image->writehist[image->md->wCBindex].wpid = getpid();
         }
-#endif
+#endif
+
+
+
+        ImageStreamIO_sempost(image, -1); // post all semaphores
+
+        if (CBdeferred)
+        {
+            // array is not rewritten before UpdateIm returns
+            ImageStreamIO_CBcopyframe(image, image->md->cnt0);
+        }
+    }
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+/**
+ * ## Purpose
+ *
+ * Publish slice of temporal circular buffer stream
+ *
+ * The slice at ImageStreamIO_writeIndex (ImageStreamIO_writeBuffer) is
+ * published: its atimearray, writetimearray and cntarray entries are set,
+ * then md->cnt1 is advanced to it (release ordering, after slice data),
+ * then ImageStreamIO_UpdateIm increments md->cnt0 and posts semaphores.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * atime    acquisition time of slice, NULL to use write time
+ *
+ **/
+long ImageStreamIO_commitSlice(
+    IMAGE *image,
+    const struct timespec *atime)
+{
+    if (image->cntarray == NULL)
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "commitSlice needs a CIRCULAR_BUFFER | ZAXIS_TEMPORAL stream");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    // ImageStreamIO_writeIndex
+    uint32_t slice = (image->md->cnt1 + 1) % image->md->size[2];
+
+    struct timespec writetime;
+    clock_gettime(CLOCK_ISIO, &writetime);
+
+    image->writetimearray[slice] = writetime;
+    image->atimearray[slice] = (atime != NULL) ? *atime : writetime;
+    image->md->writetime = writetime;
+    image->md->atime = image->atimearray[slice];
+
+    // slice data and times before cnt0 stamp, stamp before cnt1
+    __atomic_store_n(&image->cntarray[slice], image->md->cnt0 + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&image->md->cnt1, slice, __ATOMIC_RELEASE);
+
+    return ImageStreamIO_UpdateIm(image);
+}
+
+// Multi-producer slices
+// Frame ticket+1 goes to slice (ticket+1) % size[2], as with
+// ImageStreamIO_commitSlice. Reserved slices have cntarray set to
+// IMAGE_SLICE_RESERVED | PID of the producer, committed slices to their
+// cnt0; md->cnt0 and md->cnt1 are advanced over consecutive committed slices
+// by whichever producer holds md->publishPID. A slice whose producer died
+// before committing it is committed zero-filled by the next producer
+// waiting for it in ImageStreamIO_reserveSlice, and counted in
+// md->slicelostcnt.
+
+#define IMAGESTREAMIO_SLICERECLAIM_NBYIELD 64 // reserveSlice waits between dead producer checks
+
+static int ImageStreamIO_publishlock(
+    IMAGE *image,
+    pid_t pid)
+{
+    pid_t holder = 0;
+    if (__atomic_compare_exchange_n(&image->md->publishPID, &holder, pid, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    {
+        return 1;
+    }
+    // holder process died while publishing
+    if ((holder != pid) && (kill(holder, 0) == -1) && (errno == ESRCH))
+    {
+        return __atomic_compare_exchange_n(&image->md->publishPID, &holder, pid, 0,
+                                           __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+// next frame to publish is committed
+static int ImageStreamIO_slicecommitted(
+    IMAGE *image)
+{
+    uint64_t cnt0 = __atomic_load_n(&image->md->cnt0, __ATOMIC_SEQ_CST);
+    uint32_t slice = (cnt0 + 1) % image->md->size[2];
+    return __atomic_load_n(&image->cntarray[slice], __ATOMIC_SEQ_CST) == cnt0 + 1;
+}
+
+// Next frame to publish is reserved by a producer that died: commit its
+// slice zero-filled. Returns 1 if a slice was reclaimed.
+static int ImageStreamIO_slicereclaim(
+    IMAGE *image)
+{
+    uint64_t cnt0 = __atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE);
+    uint32_t slice = (cnt0 + 1) % image->md->size[2];
+    uint64_t mark = __atomic_load_n(&image->cntarray[slice], __ATOMIC_ACQUIRE);
+    pid_t holder = (pid_t)(mark & ~IMAGE_SLICE_RESERVED);
+    pid_t pid = getpid();
+
+    if (!(mark & IMAGE_SLICE_RESERVED) || (holder == pid) ||
+            (kill(holder, 0) == 0) || (errno != ESRCH))
+    {
+        return 0;
+    }
+
+    // one producer takes the slice over
+    if (!__atomic_compare_exchange_n(&image->cntarray[slice], &mark,
+                                     IMAGE_SLICE_RESERVED | (uint64_t)pid, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+        return 0;
+    }
+
+    void *buffer;
+    ImageStreamIO_readBufferAt(image, slice, &buffer);
+    memset(buffer, 0, (size_t)image->md->size[0] * image->md->size[1] *
+           ImageStreamIO_typesize(image->md->datatype));
+    __atomic_add_fetch(&image->md->slicelostcnt, 1, __ATOMIC_RELAXED);
+    ImageStreamIO_commitReservedSlice(image, cnt0, NULL);
+
+    return 1;
+}
+
+/**
+ * ## Purpose
+ *
+ * Reserve slice of temporal circular buffer, multi-producer
+ *
+ * Claims the next ticket (atomic counter md->CBticket), waits until the
+ * slice no longer holds an unpublished frame nor the latest published one,
+ * and returns the slice pointer. At most size[2] - 1 slices are reserved
+ * ahead of md->cnt0. Fill the slice, then ImageStreamIO_commitReservedSlice.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[out]
+ * ticket   slice ticket, to be committed
+ *
+ * @param[out]
+ * buffer   slice data pointer
+ *
+ **/
+errno_t ImageStreamIO_reserveSlice(
+    IMAGE *image,
+    uint64_t *ticket,
+    void **buffer)
+{
+    if (image->cntarray == NULL)
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "reserveSlice needs a CIRCULAR_BUFFER | ZAXIS_TEMPORAL stream");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    uint32_t NBslice = image->md->size[2];
+
+    // catch up with frames published by ImageStreamIO_commitSlice
+    uint64_t cnt0 = __atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE);
+    uint64_t next = __atomic_load_n(&image->md->CBticket, __ATOMIC_RELAXED);
+    while ((next < cnt0) &&
+            !__atomic_compare_exchange_n(&image->md->CBticket, &next, cnt0, 0,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+
+    uint64_t t = __atomic_fetch_add(&image->md->CBticket, 1, __ATOMIC_ACQ_REL);
+
+    // slice held frame t + 1 - NBslice: wait until it is published and
+    // no longer the latest slice (md->cnt1), which readers may be reading
+    long nbyield = 0;
+    while (t + 1 >= __atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE) + NBslice)
+    {
+        if ((++nbyield % IMAGESTREAMIO_SLICERECLAIM_NBYIELD) == 0)
+        {
+            // publishing may be stalled by a dead producer
+            ImageStreamIO_slicereclaim(image);
+        }
+        sched_yield();
+    }
+
+    uint32_t slice = (t + 1) % NBslice;
+    __atomic_store_n(&image->cntarray[slice], IMAGE_SLICE_RESERVED | (uint64_t)getpid(),
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    *ticket = t;
+    return ImageStreamIO_readBufferAt(image, slice, buffer);
+}
+
+/**
+ * ## Purpose
+ *
+ * Commit slice reserved by ImageStreamIO_reserveSlice
+ *
+ * Slices may be committed in any order. Readers only see them in ticket
+ * order: md->cnt1 and md->cnt0 advance over consecutive committed slices,
+ * and semaphores are posted when they do.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * ticket   ticket from ImageStreamIO_reserveSlice
+ *
+ * @param[in]
+ * atime    acquisition time of slice, NULL to use commit time
+ *
+ **/
+errno_t ImageStreamIO_commitReservedSlice(
+    IMAGE *image,
+    uint64_t ticket,
+    const struct timespec *atime)
+{
+    if (image->cntarray == NULL)
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "commitReservedSlice needs a CIRCULAR_BUFFER | ZAXIS_TEMPORAL stream");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    uint32_t NBslice = image->md->size[2];
+    uint32_t slice = (ticket + 1) % NBslice;
+
+    struct timespec writetime;
+    clock_gettime(CLOCK_ISIO, &writetime);
+    image->writetimearray[slice] = writetime;
+    image->atimearray[slice] = (atime != NULL) ? *atime : writetime;
+
+    // slice data and times before stamp
+    __atomic_store_n(&image->cntarray[slice], ticket + 1, __ATOMIC_SEQ_CST);
+
+    pid_t pid = getpid();
+    while (ImageStreamIO_slicecommitted(image) &&
+            ImageStreamIO_publishlock(image, pid))
+    {
+        long NBpublished = 0;
+        while (ImageStreamIO_slicecommitted(image))
+        {
+            uint64_t cnt0 = image->md->cnt0 + 1;
+            uint32_t pslice = cnt0 % NBslice;
+
+            image->md->atime = image->atimearray[pslice];
+            image->md->writetime = image->writetimearray[pslice];
+            __atomic_store_n(&image->md->cnt1, pslice, __ATOMIC_RELEASE);
+            __atomic_store_n(&image->md->cnt0, cnt0, __ATOMIC_RELEASE);
+            NBpublished++;
+        }
+        __atomic_store_n(&image->md->publishPID, 0, __ATOMIC_SEQ_CST);
+
+        if (NBpublished > 0)
+        {
+            ImageStreamIO_sempost(image, -1);
+        }
+        // loop: slices committed while lock was held are published by us
+    }
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+/**
+ * ## Purpose
+ *
+ * Copy frame from a stream, guaranteed not torn by a concurrent update
+ *
+ * Reads md->cnt0 and md->write before and after the copy (seqlock), and
+ * retries up to IMAGE_READ_CONSISTENT_MAXTRY times if the frame was
+ * updated meanwhile. Waits for an update in progress to complete, for
+ * up to IMAGE_READ_CONSISTENT_MAXWAIT_NS. Writers should bracket updates with
+ * ImageStreamIO_BeginUpdateIm and ImageStreamIO_UpdateIm.
+ *
+ * With IMAGE_OPT_CBZEROCOPY the latest CB slot (md->CBindex) is copied
+ * without waiting for the writer, which fills another slot; the copy is
+ * only retried if the slot stamp changed meanwhile (writer came back
+ * around to the slot).
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[out]
+ * dst      destination buffer, md->imdatamemsize bytes
+ *
+ * @param[out]
+ * cnt0     md->cnt0 of the frame copied, may be NULL
+ *
+ **/
+errno_t ImageStreamIO_read_consistent(
+    IMAGE *image,
+    void *dst,
+    uint64_t *cnt0)
+{
+    if (image->md->location != -1)
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_NOTIMPL,
+                                 "consistent read only supported for CPU streams");
+        return IMAGESTREAMIO_NOTIMPL;
+    }
+
+    if (image->md->imagetype & IMAGE_OPT_CBZEROCOPY)
+    {
+        for (int trycnt = 0; trycnt < IMAGE_READ_CONSISTENT_MAXTRY; trycnt++)
+        {
+            // latest slot, as ImageStreamIO_get_latest_ptr, and its stamp
+            uint32_t CBslot = __atomic_load_n(&image->md->CBindex, __ATOMIC_ACQUIRE);
+            uint64_t cnt0start = __atomic_load_n(&image->CircBuff_md[CBslot].cnt0, __ATOMIC_ACQUIRE);
+            if ((cnt0start == 0) && (__atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE) != 0))
+            {
+                // slot invalidated since CBindex was read, writer is back on it
+                continue;
+            }
+
+            void *ptr = ImageStreamIO_CBslotptr(image, CBslot);
+            ImageStreamIO_copyframe_cached(image, dst, ptr, image->md->imdatamemsize);
+
+            // nothing published yet: the writer fills the slot after CBindex
+            if ((cnt0start == 0) || ImageStreamIO_CB_check(image, cnt0start, ptr))
+            {
+                if (cnt0 != NULL)
+                {
+                    *cnt0 = cnt0start;
+                }
+                return IMAGESTREAMIO_SUCCESS;
+            }
+        }
+
+        errno = EAGAIN;
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    struct timespec tstart = {0, 0};
+
+    for (int trycnt = 0; trycnt < IMAGE_READ_CONSISTENT_MAXTRY; trycnt++)
+    {
+        uint64_t cnt0start = __atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE);
+
+        // update in progress: wait for it, up to IMAGE_READ_CONSISTENT_MAXWAIT_NS
+        long spincnt = 0;
+        while (__atomic_load_n(&image->md->write, __ATOMIC_ACQUIRE))
+        {
+            ImageStreamIO_spinwait_cnt0(&image->md->cnt0, cnt0start);
+            if ((spincnt++ & 0x3F) == 0)
+            {
+                struct timespec tnow;
+                clock_gettime(CLOCK_MONOTONIC, &tnow);
+                if (tstart.tv_sec == 0 && tstart.tv_nsec == 0)
+                {
+                    tstart = tnow;
+                }
+                else if ((tnow.tv_sec - tstart.tv_sec) * 1000000000L +
+                         (tnow.tv_nsec - tstart.tv_nsec) > IMAGE_READ_CONSISTENT_MAXWAIT_NS)
+                {
+                    errno = EAGAIN;
+                    return IMAGESTREAMIO_FAILURE;
+                }
+            }
+            cnt0start = __atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE);
+        }
+
+        ImageStreamIO_copyframe_cached(image, dst, image->array.raw, image->md->imdatamemsize);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (!__atomic_load_n(&image->md->write, __ATOMIC_ACQUIRE) &&
+                (__atomic_load_n(&image->md->cnt0, __ATOMIC_RELAXED) == cnt0start))
+        {
+            if (cnt0 != NULL)
+            {
+                *cnt0 = cnt0start;
+            }
+            return IMAGESTREAMIO_SUCCESS;
+        }
+    }
+
+    errno = EAGAIN;
+    return IMAGESTREAMIO_FAILURE;
+}
+
+/**
+ * ## Purpose
+ *
+ * Locate frame cnt0 in the fast circular buffer
+ *
+ * The slot is found from the latest slot stamp (O(1)), and its stamp
+ * is checked to hold cnt0. ptr points into the circular buffer, no data
+ * is copied: call ImageStreamIO_CB_check after using the frame data to
+ * detect it was overwritten meanwhile.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * cnt0     frame counter of requested frame
+ *
+ * @param[out]
+ * ptr      frame data in circular buffer, may be NULL
+ *
+ * @param[out]
+ * framemd  copy of frame metadata, may be NULL
+ *
+ **/
+errno_t ImageStreamIO_CB_get(
+    IMAGE *image,
+    uint64_t cnt0,
+    void **ptr,
+    CBFRAMEMD *framemd)
+{
+    uint32_t CBsize = image->md->CBsize;
+
+    if ((CBsize == 0) || (image->CircBuff_md == NULL) || (cnt0 == 0))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "no circular buffer or invalid frame counter");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    uint32_t CBindex = __atomic_load_n(&image->md->CBindex, __ATOMIC_ACQUIRE);
+    uint64_t cnt0latest = __atomic_load_n(&image->CircBuff_md[CBindex].cnt0, __ATOMIC_ACQUIRE);
+
+    if ((cnt0latest == 0) || (cnt0 > cnt0latest))
+    {
+        // not published yet
+        errno = EAGAIN;
+        return IMAGESTREAMIO_FAILURE;
+    }
+    if (cnt0latest - cnt0 >= CBsize)
+    {
+        // overwritten
+        errno = ENOENT;
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    uint32_t CBslot = (CBindex + CBsize - (uint32_t)(cnt0latest - cnt0)) % CBsize;
+    CBFRAMEMD *slotmd = &image->CircBuff_md[CBslot];
+
+    if (__atomic_load_n(&slotmd->cnt0, __ATOMIC_ACQUIRE) != cnt0)
+    {
+        // overwritten, or cnt0 not published through ImageStreamIO_UpdateIm
+        errno = ENOENT;
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    if (framemd != NULL)
+    {
+        memcpy(framemd, slotmd, sizeof(CBFRAMEMD));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slotmd->cnt0, __ATOMIC_RELAXED) != cnt0)
+        {
+            errno = ENOENT;
+            return IMAGESTREAMIO_FAILURE;
+        }
+        framemd->cnt0 = cnt0;
+    }
+
+    if (ptr != NULL)
+    {
+        *ptr = ImageStreamIO_CBslotptr(image, CBslot);
+    }
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+/**
+ * ## Purpose
+ *
+ * Check that frame cnt0 obtained by ImageStreamIO_CB_get was not
+ * overwritten, up to the time of the call
+ *
+ * Returns 1 if frame data read from ptr so far is frame cnt0, 0 otherwise.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * cnt0     frame counter passed to ImageStreamIO_CB_get
+ *
+ * @param[in]
+ * ptr      frame data pointer returned by ImageStreamIO_CB_get
+ *
+ **/
+int ImageStreamIO_CB_check(
+    IMAGE *image,
+    uint64_t cnt0,
+    const void *ptr)
+{
+    uint32_t CBslot = ((const uint8_t *)ptr - (const uint8_t *)image->CBimdata) /
+                      image->md->imdatamemsize;
+
+    // order frame data loads before stamp load
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&image->CircBuff_md[CBslot].cnt0, __ATOMIC_RELAXED) == cnt0;
+}
+
+/**
+ * ## Purpose
+ *
+ * Attach reader cursor to temporal circular buffer stream, at latest slice
+ *
+ * ## Arguments
+ *
+ * @param[out]
+ * cursor   IMAGE_CURSOR*
+ *          reader cursor
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ **/
+errno_t ImageStreamIO_cursor_init(
+    IMAGE_CURSOR *cursor,
+    IMAGE *image)
+{
+    if (((image->md->imagetype & 0xF000F) != (CIRCULAR_BUFFER | ZAXIS_TEMPORAL)) ||
+            (image->cntarray == NULL))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "cursor needs a CIRCULAR_BUFFER | ZAXIS_TEMPORAL stream");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    uint64_t slice = __atomic_load_n(&image->md->cnt1, __ATOMIC_ACQUIRE);
+
+    cursor->image = image;
+    cursor->cnt0 = __atomic_load_n(&image->cntarray[slice], __ATOMIC_ACQUIRE);
+    cursor->nblost = 0;
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+// Slices written after cursor, oldest first: nbnew slices from slice first,
+// with cnt0 cntfirst, cntfirst+1, ... Walks back from md->cnt1 while cntarray
+// holds consecutive cnt0 values newer than cursor. At most NBslice - 1
+// slices: the one after md->cnt1 is the next the writer overwrites.
+// Returns cnt0 of latest slice, or cursor->cnt0 if nothing new.
+static uint64_t ImageStreamIO_cursor_scan(
+    IMAGE_CURSOR *cursor,
+    uint32_t *first,
+    uint32_t *nbnew,
+    uint64_t *nblost)
+{
+    IMAGE *image = cursor->image;
+    uint32_t NBslice = image->md->size[2];
+
+    uint32_t slice = __atomic_load_n(&image->md->cnt1, __ATOMIC_ACQUIRE);
+    uint64_t cntlatest = __atomic_load_n(&image->cntarray[slice], __ATOMIC_ACQUIRE);
+
+    *nbnew = 0;
+    *nblost = 0;
+    if (cntlatest <= cursor->cnt0)
+    {
+        return cursor->cnt0;
+    }
+
+    uint32_t n = 0;
+    while (n < NBslice - 1)
+    {
+        uint64_t cnt = __atomic_load_n(&image->cntarray[slice], __ATOMIC_ACQUIRE);
+        // stop at consumed slice, or slice rewritten since cnt1 was read
+        if ((cnt <= cursor->cnt0) || (cnt != cntlatest - n))
+        {
+            break;
+        }
+        n++;
+        slice = (slice + NBslice - 1) % NBslice;
+    }
+
+    *first = (slice + 1) % NBslice;
+    *nbnew = n;
+    *nblost = (cntlatest - n) - cursor->cnt0;
+
+    return cntlatest;
+}
+
+int ImageStreamIO_cursor_next(
+    IMAGE_CURSOR *cursor,
+    uint32_t *slice,
+    uint64_t *nblost)
+{
+    uint32_t first;
+    uint32_t nbnew;
+    uint64_t lost;
+
+    uint64_t cntlatest = ImageStreamIO_cursor_scan(cursor, &first, &nbnew, &lost);
+    if (nblost != NULL)
+    {
+        *nblost = lost;
+    }
+    if (nbnew == 0)
+    {
+        return 0;
+    }
+
+    *slice = first;
+    cursor->cnt0 = cntlatest - nbnew + 1;
+    cursor->nblost += lost;
+
+    return 1;
+}
+
+int ImageStreamIO_cursor_drain(
+    IMAGE_CURSOR *cursor,
+    IMAGE_SLICERANGE range[2],
+    uint64_t *nblost)
+{
+    uint32_t NBslice = cursor->image->md->size[2];
+    uint32_t first;
+    uint32_t nbnew;
+    uint64_t lost;
+
+    uint64_t cntlatest = ImageStreamIO_cursor_scan(cursor, &first, &nbnew, &lost);
+    if (nblost != NULL)
+    {
+        *nblost = lost;
+    }
+    if (nbnew == 0)
+    {
+        return 0;
+    }
+
+    int nbrange = 1;
+    range[0].slice = first;
+    range[0].nslice = (first + nbnew <= NBslice) ? nbnew : NBslice - first;
+    range[0].cnt0 = cntlatest - nbnew + 1;
+    if (range[0].nslice < nbnew)
+    {
+        // wraps around end of buffer
+        range[1].slice = 0;
+        range[1].nslice = nbnew - range[0].nslice;
+        range[1].cnt0 = range[0].cnt0 + range[0].nslice;
+        nbrange = 2;
+    }
+
+    cursor->cnt0 = cntlatest;
+    cursor->nblost += lost;
+
+    return nbrange;
+}
+
+/**
+ * ## Purpose
+ *
+ * Check slice returned by cursor was not overwritten while being read
+ *
+ * Returns 1 if slice data read so far is still frame cnt0, 0 if the
+ * writer rewrote the slice or may be writing it (it is the slice after
+ * the latest one).
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * cursor   IMAGE_CURSOR*
+ *          reader cursor
+ *
+ * @param[in]
+ * slice    slice index, from ImageStreamIO_cursor_next or _drain
+ *
+ * @param[in]
+ * cnt0     frame counter of slice
+ *
+ **/
+int ImageStreamIO_cursor_check(
+    IMAGE_CURSOR *cursor,
+    uint32_t slice,
+    uint64_t cnt0)
+{
+    IMAGE *image = cursor->image;
+    uint32_t NBslice = image->md->size[2];
+
+    // order slice data loads before cntarray loads
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&image->cntarray[slice], __ATOMIC_RELAXED) != cnt0)
+    {
+        return 0;
+    }
+
+    // frame cnt0 + NBslice, written next to this slice, not started
+    uint32_t latest = __atomic_load_n(&image->md->cnt1, __ATOMIC_ACQUIRE);
+    uint64_t cntlatest = __atomic_load_n(&image->cntarray[latest], __ATOMIC_ACQUIRE);
+    return cntlatest + 1 < cnt0 + NBslice;
+}
+
+// Event ring
+// _DATATYPE_EVENT_UI8_UI8_UI16_UI8 streams hold events in the data array
+// used as a ring of md->nelement records: event number n (counting from 0
+// since creation) is at index n % nelement. md->cnt2 is the number of
+// events published. While a batch is appended, md->cnt2next is cnt2 plus
+// the batch size: readers discard events that the batch may overwrite.
+// Single writer, readers never block the writer.
+
+// copy nevent records between ring position evpos and flat buffer
+static void ImageStreamIO_event_ringcopy(
+    IMAGE *image,
+    uint64_t evpos,
+    void *buf,
+    uint64_t nevent,
+    int toring)
+{
+    uint64_t NBring = image->md->nelement;
+    uint64_t index = evpos % NBring;
+    uint64_t n1 = (index + nevent <= NBring) ? nevent : NBring - index;
+    uint8_t *ring = (uint8_t *)image->array.raw;
+    uint8_t *flat = (uint8_t *)buf;
+
+    if (toring)
+    {
+        memcpy(ring + index * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8, flat,
+               n1 * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8);
+        memcpy(ring, flat + n1 * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8,
+               (nevent - n1) * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8);
+    }
+    else
+    {
+        memcpy(flat, ring + index * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8,
+               n1 * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8);
+        memcpy(flat + n1 * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8, ring,
+               (nevent - n1) * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8);
+    }
+}
+
+/**
+ * ## Purpose
+ *
+ * Append batch of events to event ring stream
+ *
+ * Events are copied into the ring after the last published event,
+ * wrapping around, and the batch metadata entry is written. md->cnt2 is
+ * then advanced by nevent, md->cnt1 set to the batch entry index, and
+ * ImageStreamIO_UpdateIm increments md->cnt0 and posts semaphores. The
+ * oldest events are overwritten, whether or not readers have consumed
+ * them.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * events   nevent event records
+ *
+ * @param[in]
+ * nevent   number of events, at most md->nelement
+ *
+ * @param[in]
+ * atime    acquisition time of batch, NULL to use append time
+ *
+ **/
+errno_t ImageStreamIO_event_append(
+    IMAGE *image,
+    const EVENT_UI8_UI8_UI16_UI8 *events,
+    uint64_t nevent,
+    const struct timespec *atime)
+{
+    if (image->eventbatch == NULL)
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "event_append needs a shared _DATATYPE_EVENT_UI8_UI8_UI16_UI8 stream");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+    if (nevent > image->md->nelement)
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "event batch larger than event ring");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
+
+    uint64_t cnt2 = image->md->cnt2;
+    uint64_t cnt0 = image->md->cnt0 + 1;
+    IMAGE_EVENTBATCH *batch = &image->eventbatch[cnt0 % IMAGE_EVENT_NBBATCH];
+
+    // announce events about to be overwritten, and invalidate batch entry,
+    // before ring stores
+    __atomic_store_n(&image->md->write, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&image->md->cnt2next, cnt2 + nevent, __ATOMIC_RELAXED);
+    __atomic_store_n(&batch->cnt0, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    ImageStreamIO_event_ringcopy(image, cnt2, (void *)events, nevent, 1);
+
+    struct timespec writetime;
+    clock_gettime(CLOCK_ISIO, &writetime);
+    batch->evstart = cnt2;
+    batch->nevent = nevent;
+    batch->writetime = writetime;
+    batch->atime = (atime != NULL) ? *atime : writetime;
+    __atomic_store_n(&batch->cnt0, cnt0, __ATOMIC_RELEASE);
+
+    image->md->atime = batch->atime;
+    image->md->writetime = writetime;
+    __atomic_store_n(&image->md->cnt1, cnt0 % IMAGE_EVENT_NBBATCH, __ATOMIC_RELEASE);
+    __atomic_store_n(&image->md->cnt2, cnt2 + nevent, __ATOMIC_RELEASE);
+
+    return ImageStreamIO_UpdateIm(image);
+}
+
+/**
+ * ## Purpose
+ *
+ * Read events of event ring stream, appended since a given event index
+ *
+ * Copies up to maxevent events, starting at event *since, and advances
+ * *since past them: start with *since = 0 (or md->cnt2 to skip existing
+ * events) and call again to read new events. Events overwritten before
+ * they could be copied are skipped and counted in *nblost.
+ * Returns number of events copied into dst.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in,out]
+ * since    index of first event to read, updated to next event to read
+ *
+ * @param[out]
+ * dst      room for maxevent events
+ *
+ * @param[in]
+ * maxevent maximum number of events to read
+ *
+ * @param[out]
+ * nblost   number of events skipped, may be NULL
+ *
+ **/
+uint64_t ImageStreamIO_event_read(
+    IMAGE *image,
+    uint64_t *since,
+    EVENT_UI8_UI8_UI16_UI8 *dst,
+    uint64_t maxevent,
+    uint64_t *nblost)
+{
+    uint64_t NBring = image->md->nelement;
+    uint64_t cnt2 = __atomic_load_n(&image->md->cnt2, __ATOMIC_ACQUIRE);
+    uint64_t first = *since;
+    uint64_t lost = 0;
+
+    if (first > cnt2)
+    {
+        // stream re-created, or invalid index
+        first = cnt2;
+    }
+    if (cnt2 - first > NBring)
+    {
+        lost = cnt2 - NBring - first;
+        first = cnt2 - NBring;
+    }
+
+    uint64_t nevent = cnt2 - first;
+    if (nevent > maxevent)
+    {
+        nevent = maxevent;
+    }
+    ImageStreamIO_event_ringcopy(image, first, dst, nevent, 0);
+
+    // events overwritten by a batch appended meanwhile are dropped
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t cnt2next = __atomic_load_n(&image->md->cnt2next, __ATOMIC_RELAXED);
+    if (cnt2next > first + NBring)
+    {
+        uint64_t nover = cnt2next - NBring - first;
+        if (nover > nevent)
+        {
+            nover = nevent;
+        }
+        memmove(dst, dst + nover, (nevent - nover) * SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8);
+        lost += nover;
+        first += nover;
+        nevent -= nover;
+    }
+
+    *since = first + nevent;
+    if (nblost != NULL)
+    {
+        *nblost = lost;
+    }
+
+    return nevent;
+}
 
+/**
+ * ## Purpose
+ *
+ * Get metadata of event batch cnt0
+ *
+ * Returns IMAGESTREAMIO_FAILURE with errno EAGAIN if the batch is not
+ * published yet, ENOENT if its entry was reused by a later batch
+ * (IMAGE_EVENT_NBBATCH entries are kept).
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * cnt0     md->cnt0 value of batch
+ *
+ * @param[out]
+ * batch    copy of batch metadata
+ *
+ **/
+errno_t ImageStreamIO_event_batch(
+    IMAGE *image,
+    uint64_t cnt0,
+    IMAGE_EVENTBATCH *batch)
+{
+    if ((image->eventbatch == NULL) || (cnt0 == 0))
+    {
+        ImageStreamIO_printERROR(IMAGESTREAMIO_INVALIDARG,
+                                 "no event batch metadata or invalid batch counter");
+        return IMAGESTREAMIO_INVALIDARG;
+    }
 
+    if (cnt0 > __atomic_load_n(&image->md->cnt0, __ATOMIC_ACQUIRE))
+    {
+        errno = EAGAIN;
+        return IMAGESTREAMIO_FAILURE;
+    }
 
-        ImageStreamIO_sempost(image, -1); // post all semaphores
+    IMAGE_EVENTBATCH *entry = &image->eventbatch[cnt0 % IMAGE_EVENT_NBBATCH];
+    if (__atomic_load_n(&entry->cnt0, __ATOMIC_ACQUIRE) != cnt0)
+    {
+        errno = ENOENT;
+        return IMAGESTREAMIO_FAILURE;
+    }
+    memcpy(batch, entry, sizeof(IMAGE_EVENTBATCH));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&entry->cnt0, __ATOMIC_RELAXED) != cnt0)
+    {
+        errno = ENOENT;
+        return IMAGESTREAMIO_FAILURE;
+    }
+    batch->cnt0 = cnt0;
+
+    return IMAGESTREAMIO_SUCCESS;
+}
+
+/* ===============================================================================================
+ */
+/* ===============================================================================================
+ */
+/* @name 3. STREAM REGISTRY
+ *
+ */
+/* ===============================================================================================
+ */
+/* ===============================================================================================
+ */
+
+// Registry file in the shm directory, mapped once per process.
+// Writers (create / destroy) serialize on lockPID, readers are lock-free and
+// use the per-entry seq counter to detect concurrent updates.
+
+static IMAGE_REGISTRY *ImageStreamIO_registry_map = NULL;
+
+// returns registry mapping, NULL if unavailable
+static IMAGE_REGISTRY *ImageStreamIO_registry(void)
+{
+    IMAGE_REGISTRY *registry = __atomic_load_n(&ImageStreamIO_registry_map, __ATOMIC_ACQUIRE);
+    if (registry != NULL)
+    {
+        return registry;
+    }
+
+    char shmdirname[STRINGMAXLEN_DIR_NAME];
+    char fname[STRINGMAXLEN_DIR_NAME + 32];
+    ImageStreamIO_shmdirname(shmdirname);
+    snprintf(fname, sizeof(fname), "%s/%s", shmdirname, IMAGE_REGISTRY_FILENAME);
+
+    umask(0);
+    int fd = open(fname, O_RDWR | O_CREAT, (mode_t)FILEMODE);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if ((fstat(fd, &file_stat) == -1) ||
+            ((file_stat.st_size == 0) && (ftruncate(fd, sizeof(IMAGE_REGISTRY)) == -1)) ||
+            ((file_stat.st_size != 0) && (file_stat.st_size != sizeof(IMAGE_REGISTRY))))
+    {
+        // incompatible registry file
+        close(fd);
+        return NULL;
+    }
+
+    registry = (IMAGE_REGISTRY *)mmap(0, sizeof(IMAGE_REGISTRY), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (registry == MAP_FAILED)
+    {
+        return NULL;
     }
 
+    // new registry file is all zeros: empty, initialize header
+    uint32_t nbentry = 0;
+    if (__atomic_load_n(&registry->nbentry, __ATOMIC_ACQUIRE) == 0)
+    {
+        strncpy(registry->version, IMAGE_REGISTRY_VERSION, sizeof(registry->version));
+        __atomic_compare_exchange_n(&registry->nbentry, &nbentry, IMAGE_REGISTRY_NBENTRY, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+    if ((__atomic_load_n(&registry->nbentry, __ATOMIC_ACQUIRE) != IMAGE_REGISTRY_NBENTRY) ||
+            (strncmp(registry->version, IMAGE_REGISTRY_VERSION, sizeof(registry->version)) != 0))
+    {
+        munmap(registry, sizeof(IMAGE_REGISTRY));
+        return NULL;
+    }
+
+    IMAGE_REGISTRY *mapped = NULL;
+    if (!__atomic_compare_exchange_n(&ImageStreamIO_registry_map, &mapped, registry, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        // mapped by another thread meanwhile
+        munmap(registry, sizeof(IMAGE_REGISTRY));
+        registry = mapped;
+    }
+    return registry;
+}
+
+// FNV-1a hash of stream name
+static uint32_t ImageStreamIO_registry_hash(
+    const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; (i < STRINGMAXLEN_IMAGE_NAME) && (name[i] != '\0'); i++)
+    {
+        hash ^= (uint8_t) name[i];
+        hash *= 16777619u;
+    }
+    return hash & (IMAGE_REGISTRY_NBENTRY - 1);
+}
+
+static void ImageStreamIO_registry_lock(
+    IMAGE_REGISTRY *registry)
+{
+    pid_t pid = getpid();
+    for (;;)
+    {
+        pid_t holder = 0;
+        if (__atomic_compare_exchange_n(&registry->lockPID, &holder, pid, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            return;
+        }
+        if ((holder != pid) && (getpgid(holder) < 0))
+        {
+            // lock holder died, take over
+            if (__atomic_compare_exchange_n(&registry->lockPID, &holder, pid, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            {
+                // release entry left half-updated
+                for (long index = 0; index < IMAGE_REGISTRY_NBENTRY; index++)
+                {
+                    if (__atomic_load_n(&registry->entry[index].seq, __ATOMIC_RELAXED) & 1)
+                    {
+                        __atomic_fetch_add(&registry->entry[index].seq, 1, __ATOMIC_RELEASE);
+                    }
+                }
+                return;
+            }
+        }
+        sched_yield();
+    }
+}
+
+static void ImageStreamIO_registry_unlock(
+    IMAGE_REGISTRY *registry)
+{
+    __atomic_store_n(&registry->lockPID, 0, __ATOMIC_RELEASE);
+}
+
+// consistent copy of entry, returns its state
+static uint32_t ImageStreamIO_registry_read(
+    IMAGE_REGISTRY_ENTRY *regentry,
+    IMAGE_REGISTRY_ENTRY *entry)
+{
+    for (;;)
+    {
+        uint32_t seq = __atomic_load_n(&regentry->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            sched_yield();
+            continue;
+        }
+        memcpy(entry, regentry, sizeof(IMAGE_REGISTRY_ENTRY));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&regentry->seq, __ATOMIC_RELAXED) == seq)
+        {
+            return entry->state;
+        }
+    }
+}
+
+// index of entry for name, or of the free entry ending its probe sequence
+// returns -1 if name not found and table full
+static long ImageStreamIO_registry_find(
+    IMAGE_REGISTRY *registry,
+    const char *name,
+    int *found)
+{
+    uint32_t h = ImageStreamIO_registry_hash(name);
+    IMAGE_REGISTRY_ENTRY entry;
+
+    *found = 0;
+    for (uint32_t i = 0; i < IMAGE_REGISTRY_NBENTRY; i++)
+    {
+        long index = (h + i) & (IMAGE_REGISTRY_NBENTRY - 1);
+        uint32_t state = ImageStreamIO_registry_read(&registry->entry[index], &entry);
+        if (state == IMAGE_REGISTRY_FREE)
+        {
+            return index;
+        }
+        if (strncmp(entry.name, name, STRINGMAXLEN_IMAGE_NAME) == 0)
+        {
+            *found = 1;
+            return index;
+        }
+    }
+    return -1;
+}
+
+static void ImageStreamIO_registry_add(
+    const IMAGE *image)
+{
+    IMAGE_REGISTRY *registry = ImageStreamIO_registry();
+    if (registry == NULL)
+    {
+        return;
+    }
+
+    ImageStreamIO_registry_lock(registry);
+
+    int found;
+    long index = ImageStreamIO_registry_find(registry, image->md->name, &found);
+    for (long i = 0; (index < 0) && (i < IMAGE_REGISTRY_NBENTRY); i++)
+    {
+        // table full: recycle entry of a destroyed stream
+        if (registry->entry[i].state == IMAGE_REGISTRY_REMOVED)
+        {
+            index = i;
+        }
+    }
+    if (index >= 0)
+    {
+        IMAGE_REGISTRY_ENTRY *entry = &registry->entry[index];
+
+        __atomic_fetch_add(&entry->seq, 1, __ATOMIC_ACQ_REL);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        if (!found)
+        {
+            strncpy(entry->name, image->md->name, STRINGMAXLEN_IMAGE_NAME);
+            entry->name[STRINGMAXLEN_IMAGE_NAME-1] = '\0';
+            entry->createcnt = 0;
+        }
+        entry->inode = image->md->inode;
+        entry->memsize = image->memsize;
+        entry->datatype = image->md->datatype;
+        entry->creatorPID = image->md->creatorPID;
+        entry->createcnt++;
+        entry->state = IMAGE_REGISTRY_USED;
+        __atomic_fetch_add(&entry->seq, 1, __ATOMIC_RELEASE);
+    }
+
+    ImageStreamIO_registry_unlock(registry);
+}
+
+static void ImageStreamIO_registry_remove(
+    const char *name,
+    ino_t inode)
+{
+    IMAGE_REGISTRY *registry = ImageStreamIO_registry();
+    if (registry == NULL)
+    {
+        return;
+    }
+
+    ImageStreamIO_registry_lock(registry);
+
+    int found;
+    long index = ImageStreamIO_registry_find(registry, name, &found);
+    // only if not re-created by another process meanwhile
+    if (found && (registry->entry[index].inode == inode))
+    {
+        IMAGE_REGISTRY_ENTRY *entry = &registry->entry[index];
+
+        __atomic_fetch_add(&entry->seq, 1, __ATOMIC_ACQ_REL);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        entry->state = IMAGE_REGISTRY_REMOVED;
+        __atomic_fetch_add(&entry->seq, 1, __ATOMIC_RELEASE);
+    }
+
+    ImageStreamIO_registry_unlock(registry);
+}
+
+/**
+ * ## Purpose
+ *
+ * Look up stream in registry
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * name     stream name
+ *
+ * @param[out]
+ * entry    registry entry, may be NULL for an existence check
+ *
+ **/
+errno_t ImageStreamIO_registry_lookup(
+    const char *name,
+    IMAGE_REGISTRY_ENTRY *entry)
+{
+    IMAGE_REGISTRY *registry = ImageStreamIO_registry();
+    if (registry == NULL)
+    {
+        return IMAGESTREAMIO_FILEOPEN;
+    }
+
+    int found;
+    long index = ImageStreamIO_registry_find(registry, name, &found);
+    if (!found)
+    {
+        return IMAGESTREAMIO_FAILURE;
+    }
+
+    IMAGE_REGISTRY_ENTRY lclentry;
+    if (ImageStreamIO_registry_read(&registry->entry[index], &lclentry) != IMAGE_REGISTRY_USED)
+    {
+        return IMAGESTREAMIO_FAILURE;
+    }
+    if (entry != NULL)
+    {
+        *entry = lclentry;
+    }
     return IMAGESTREAMIO_SUCCESS;
 }
+
+/**
+ * ## Purpose
+ *
+ * List streams in registry
+ *
+ * ## Arguments
+ *
+ * @param[out]
+ * entries  array of maxentries registry entries, may be NULL to count streams
+ *
+ * @param[in]
+ * maxentries size of entries array
+ *
+ **/
+long ImageStreamIO_registry_list(
+    IMAGE_REGISTRY_ENTRY *entries,
+    long maxentries)
+{
+    IMAGE_REGISTRY *registry = ImageStreamIO_registry();
+    if (registry == NULL)
+    {
+        return -1;
+    }
+
+    long nbstream = 0;
+    IMAGE_REGISTRY_ENTRY entry;
+    for (long index = 0; index < IMAGE_REGISTRY_NBENTRY; index++)
+    {
+        if ((__atomic_load_n(&registry->entry[index].state, __ATOMIC_RELAXED) != IMAGE_REGISTRY_FREE) &&
+                (ImageStreamIO_registry_read(&registry->entry[index], &entry) == IMAGE_REGISTRY_USED))
+        {
+            if ((entries != NULL) && (nbstream < maxentries))
+            {
+                entries[nbstream] = entry;
+            }
+            nbstream++;
+        }
+    }
+    return nbstream;
+}
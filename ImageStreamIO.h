@@ -218,6 +218,105 @@ int ImageStreamIO_FITSIObitpix(uint8_t
 
 int ImageStreamIO_FITSIOdatatype(uint8_t datatype);
 
+
+// ImageStreamIO_copy_path paths
+#define IMAGE_COPY_AUTO       0  /**< as ImageStreamIO_copy */
+#define IMAGE_COPY_MEMCPY     1  /**< regular stores (memcpy) */
+#define IMAGE_COPY_SSE2_NT    2  /**< SSE2 non-temporal stores */
+#define IMAGE_COPY_AVX2_NT    3  /**< AVX2 non-temporal stores */
+#define IMAGE_COPY_AVX512_NT  4  /**< AVX-512 non-temporal stores */
+
+/** @brief Copy frame data
+  *
+  * Copy used for writer-side frame copies in the library (circular buffer
+  * history). Frames of at least half the last level cache size are copied
+  * with non-temporal stores (widest path supported by the CPU, selected at
+  * library load), so they do not evict the caller's working set. Smaller
+  * copies use memcpy.
+  *
+  * \returns dst
+  */
+void *ImageStreamIO_copy(
+    void *dst,        ///< [out] destination
+    const void *src,  ///< [in] source
+    size_t n          ///< [in] number of bytes
+);
+
+/** @brief Copy with a given IMAGE_COPY_XXX path, for benchmarking
+  *
+  * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_NOTIMPL if path is not supported by the CPU
+  */
+errno_t ImageStreamIO_copy_path(
+    void *dst,        ///< [out] destination
+    const void *src,  ///< [in] source
+    size_t n,         ///< [in] number of bytes
+    int path          ///< [in] IMAGE_COPY_XXX path
+);
+
+const char *ImageStreamIO_copy_pathname(
+    int path
+);
+
+
+#define IMAGE_COPYPOOL_MINSIZE (4UL * 1024 * 1024) /**< default frame size [bytes] above which copies use the worker pool */
+
+/** @brief Split frame copies of this stream across threads
+  *
+  * Opt-in: frame copies of at least minsize bytes made for this IMAGE
+  * (circular buffer copy, ImageStreamIO_read_consistent, Python write)
+  * are split between the calling thread and nbthread - 1 persistent
+  * workers, pinned round-robin to NUMA nodes. The worker pool is shared
+  * by the process and runs one copy at a time, other copies fall back to
+  * a single thread. Setting is local to this process.
+  *
+  * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG if nbthread out of range
+  */
+errno_t ImageStreamIO_set_copythreads(
+    IMAGE *image,   ///< [in] the image stream
+    int nbthread,   ///< [in] threads per copy, 1: single thread, 0: one per NUMA node (at least 2)
+    size_t minsize  ///< [in] frame size [bytes] from which copies are split, 0: IMAGE_COPYPOOL_MINSIZE
+);
+
+/** @brief Copy frame of stream image
+  *
+  * ImageStreamIO_copy, split across threads as set by ImageStreamIO_set_copythreads.
+  *
+  * \returns dst
+  */
+void *ImageStreamIO_copyframe(
+    const IMAGE *image, ///< [in] the image stream
+    void *dst,          ///< [out] destination
+    const void *src,    ///< [in] source
+    size_t n            ///< [in] number of bytes
+);
+
+/** @brief Copy frame of stream image into buffer about to be read
+  *
+  * As ImageStreamIO_copyframe, with regular stores at any size, so that
+  * the copy stays in the caller's cache. For reader-side copies
+  * (ImageStreamIO_read_consistent, Python read).
+  *
+  * \returns dst
+  */
+void *ImageStreamIO_copyframe_cached(
+    const IMAGE *image, ///< [in] the image stream
+    void *dst,          ///< [out] destination
+    const void *src,    ///< [in] source
+    size_t n            ///< [in] number of bytes
+);
+
+/** @brief Pin calling thread to the NUMA node holding stream data
+  *
+  * For streams created with IMAGE_OPT_NUMABIND, sets the calling thread
+  * affinity to the CPUs of node md->numanode.
+  *
+  * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_FAILURE with errno ENOENT
+  * if stream data is not bound to a node with CPUs
+  */
+errno_t ImageStreamIO_numa_pin(
+    const IMAGE *image  ///< [in] the image stream
+);
+
 ///@}
 
 /* =============================================================================================== */
@@ -241,7 +340,13 @@ errno_t ImageStreamIO_createIm(
 
 );
 
-/** @brief Create shared memory image stream */
+/** @brief Create shared memory image stream
+ *
+ * With IMAGE_OPT_REUSE in imagetype, an existing shared CPU stream with the
+ * same name, datatype, geometry, NBkw, NBsem, CBsize and options is
+ * re-used: counters are reset in place, file, data and semaphores are kept
+ * and connected readers stay attached. Otherwise the stream is created anew.
+ */
 errno_t ImageStreamIO_createIm_gpu(
     IMAGE *image,      ///< [out] IMAGE structure which will have its members allocated and initialized.
     const char
@@ -253,7 +358,7 @@ errno_t ImageStreamIO_createIm_gpu(
     int shared,        ///< [in] if true then a shared memory buffer is allocated.  If false, only local storage is used.
     int NBsem,         ///< [in] the number of semaphores to allocate.
     int NBkw,          ///< [in] the number of keywords to allocate.
-    uint64_t imagetype,///< [in] type of the stream
+    uint64_t imagetype,///< [in] type of the stream, optionally OR-ed with IMAGE_OPT_XXX stream options
     uint32_t CBsize    ///< [in] Number of circ buff frames if shared mem, 0 if unused
 );
 
@@ -268,6 +373,10 @@ errno_t ImageStreamIO_createIm_gpu(
   * For a non-shred image:
   * Deallocates all arrays and sets pointers to NULL.
   *
+  * If image is a cached handle (see ImageStreamIO_set_opencache), its cache
+  * entry is removed: other cached handles of that stream become invalid and
+  * must be neither used nor closed.
+  *
   * \returns IMAGESTREAMIO_SUCCESS on success
   * \returns IMAGESTREAMIO_FAILURE on an error (but currently no checks done)
   *
@@ -286,8 +395,62 @@ errno_t ImageStreamIO_openIm(
     *name ///< [in] the name of the shared memory file will be data.tmpfsdir/<name>_im.shm
 );
 
+
+// ImageStreamIO_openIm_flags flags
+#define IMAGE_OPEN_LAZYSEM    0x0001  /**< named semaphores attached on first use instead of at open */
+#define IMAGE_OPEN_POPULATE   0x0002  /**< map with MAP_POPULATE, as IMAGE_OPT_POPULATE */
+#define IMAGE_OPEN_MLOCK      0x0004  /**< lock mapping in memory, as IMAGE_OPT_MLOCK */
+#define IMAGE_OPEN_PRETOUCH   0x0008  /**< touch every page from calling thread, as IMAGE_OPT_PRETOUCH */
+#define IMAGE_OPEN_CACHED     0x0010  /**< share one refcounted mapping per stream within the process, see ImageStreamIO_set_opencache */
+
+/** @brief Connect to an existing shared memory image stream, with options
+  *
+  * flags are OR-ed IMAGE_OPEN_XXX defines. With IMAGE_OPEN_LAZYSEM no
+  * semaphore is opened until first used by a wait, post, flush or
+  * ImageStreamIO_getsemwaitindex call, which speeds up attaching to
+  * streams that are only read.
+  * IMAGE_OPEN_POPULATE, IMAGE_OPEN_MLOCK and IMAGE_OPEN_PRETOUCH prepare the
+  * mapping so that first frames do not take page faults; they also apply
+  * when the stream was created with the matching IMAGE_OPT_XXX. Result is
+  * reported in image->memstatus.
+  * With IMAGE_OPEN_CACHED, or once ImageStreamIO_set_opencache(1) is called,
+  * handles on the same stream share the mapping of the first open; see
+  * ImageStreamIO_set_opencache.
+  */
+errno_t ImageStreamIO_openIm_flags(
+    IMAGE *image,     ///< [out] IMAGE structure which will be attached to the existing IMAGE
+    const char *name, ///< [in] the name of the shared memory file will be data.tmpfsdir/<name>_im.shm
+    int flags         ///< [in] IMAGE_OPEN_XXX flags
+);
+
+/** @brief Cache stream mappings for all opens of this process
+  *
+  * When enabled, ImageStreamIO_openIm, ImageStreamIO_openIm_flags and
+  * ImageStreamIO_read_sharedmem_image_toIMAGE return a copy of a handle
+  * kept per stream name and inode: repeated opens share one mapping and
+  * its semaphores, and cost a stat call. ImageStreamIO_closeIm drops a
+  * reference and unmaps on the last one. Cached handles must be released
+  * with ImageStreamIO_closeIm, not ImageStreamIO_destroyIm.
+  * Handles already open are not affected.
+  *
+  * \returns IMAGESTREAMIO_SUCCESS
+  */
+errno_t ImageStreamIO_set_opencache(
+    int enable  ///< [in] 1: cache all opens, 0: only opens with IMAGE_OPEN_CACHED
+);
+
 void *ImageStreamIO_get_image_d_ptr(IMAGE *image);
 
+/** @brief Pointer to latest published frame
+  *
+  * array.raw for regular streams. With IMAGE_OPT_CBZEROCOPY, array.raw is
+  * the circular buffer slot being written and the latest frame is slot
+  * md->CBindex, returned here.
+  */
+void *ImageStreamIO_get_latest_ptr(
+    const IMAGE *image ///< [in] the image stream
+);
+
 
 /** @brief Read / connect to existing shared memory image stream */
 errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
@@ -297,6 +460,24 @@ errno_t ImageStreamIO_read_sharedmem_image_toIMAGE(
 );
 
 
+/** @brief Remap image onto re-created stream
+ *
+ * Checks whether the stream file was replaced since image was opened
+ * (destroyed and created again, new inode). If so, and the new stream is
+ * ready, image is closed and opened again on it, keeping the semaphore
+ * indices this process held. Old mapping stays valid until then, so
+ * readers of a destroyed stream see its last frame.
+ *
+ * Called by the semaphore wait functions; readers that only poll data can
+ * call it when the writer stops updating.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS if remapped, IMAGESTREAMIO_FAILURE with
+ * errno EAGAIN if the stream was not re-created (yet)
+ */
+errno_t ImageStreamIO_reconnect(
+    IMAGE *image  ///< [in,out] the image stream
+);
+
 /** @brief Close a shared memmory image stream.
   *
   * For use in clients, detaches and cleans up memory used by non-owner process.
@@ -433,14 +614,92 @@ long ImageStreamIO_sempost_loop(
 
 /** @brief Get available semaphore index
  *
+ * Claims semindexdefault if available, any free index otherwise.
+ * Indices are claimed with compare-and-swap on semReadPID, and indices
+ * held by dead readers are reclaimed once their lease (IMAGE_SEMLEASE_NS)
+ * expires.
  *
- *
+ * \returns semaphore index, -1 if none available
  */
 int ImageStreamIO_getsemwaitindex(
     IMAGE *image,  ///< [in] the name of the shared memory file
     int semindexdefault
 );
 
+/** @brief Release semaphore index claimed by this process
+ *
+ * ## Purpose
+ *
+ * Free semaphore index obtained from ImageStreamIO_getsemwaitindex so
+ * that other readers can claim it right away.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * semindex semaphore index
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG if index not held by this process
+ */
+errno_t ImageStreamIO_releasesemwaitindex(
+    IMAGE *image,  ///< [in] the name of the shared memory file
+    int semindex   ///< [in] semaphore index
+);
+
+/** @brief Set writer flow control policy of stream
+ *
+ * Applies to readers declared required with ImageStreamIO_flow_register,
+ * see ImageStreamIO_flowcontrol.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG if policy unknown or stream not shared
+ */
+errno_t ImageStreamIO_set_flowpolicy(
+    IMAGE *image,   ///< [in] the shared memory image
+    uint8_t policy  ///< [in] IMAGE_FLOW_OVERWRITE, IMAGE_FLOW_BLOCK or IMAGE_FLOW_DROP
+);
+
+/** @brief Declare reader as required (or not) by writer flow control
+ *
+ * Sets IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED on the reader semaphore index,
+ * and its consumed position (semreader[].cnt0) to the current frame. The flag
+ * is cleared when the index is claimed again.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG
+ */
+errno_t ImageStreamIO_flow_register(
+    IMAGE *image,   ///< [in] the shared memory image
+    int semindex,   ///< [in] semaphore index, from ImageStreamIO_getsemwaitindex
+    int required    ///< [in] 1 if reader must not lose frames
+);
+
+/** @brief Report last frame consumed by reader
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG
+ */
+errno_t ImageStreamIO_flow_consumed(
+    IMAGE *image,   ///< [in] the shared memory image
+    int semindex,   ///< [in] semaphore index
+    uint64_t cnt0   ///< [in] cnt0 of last frame consumed
+);
+
+/** @brief Apply stream flow policy before writing next frame
+ *
+ * Writer calls it before each frame. The writer may run ahead of the
+ * slowest required reader by the number of frames the stream holds
+ * (CBsize, else size[2] - 1 for temporal circular buffers, else 1). Beyond
+ * that, IMAGE_FLOW_BLOCK waits and IMAGE_FLOW_DROP asks to skip the frame.
+ * Slices reserved with ImageStreamIO_reserveSlice count as written.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS if frame can be written,
+ * IMAGESTREAMIO_FAILURE with errno ENOBUFS if it should be dropped
+ */
+errno_t ImageStreamIO_flowcontrol(
+    IMAGE *image    ///< [in] the shared memory image
+);
+
 
 /** @brief Wait for semaphore
  *
@@ -458,6 +717,16 @@ int ImageStreamIO_getsemwaitindex(
  * index    semaphore index
  *
  */
+/*
+ * A writer destroying or re-creating a shared stream clears
+ * IMAGE_SEMAPHORE_CONTROL_READY of all semaphores and posts them. Waits
+ * on a semaphore that is not ready poll until it is ready again, or until
+ * the stream is re-created: the IMAGE is then remapped onto the new
+ * stream (ImageStreamIO_reconnect) and the wait returns -1 with errno
+ * ESTALE, so that the caller re-reads the stream geometry. Timed waits
+ * return -1 with ETIMEDOUT if neither happens in time, semtrywait -1 with
+ * EAGAIN.
+ */
 int ImageStreamIO_semwait(
     IMAGE *image,  ///< [in] the name of the shared memory file
     int index      ///< [in] semaphore index
@@ -473,6 +742,86 @@ int ImageStreamIO_semtimedwait(
 );
 
 
+#define IMAGE_SEMWAIT_SPIN   1   /**< ImageStreamIO_semspinwait returned from the spin phase */
+#define IMAGE_SEMWAIT_BLOCK  2   /**< ImageStreamIO_semspinwait returned from the blocking wait */
+
+/** @brief Spin then block on semaphore
+ *
+ * ## Purpose
+ *
+ * Poll md->cnt0 for up to spinns nanoseconds (pause or umwait), then
+ * fall back to a blocking (or timed) semaphore wait.
+ * The spin budget can be tuned per reader, for example from the
+ * fraction of IMAGE_SEMWAIT_SPIN returns.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[in]
+ * index    semaphore index
+ *
+ * @param[in]
+ * spinns   spin budget [ns]
+ *
+ * @param[in]
+ * semwts   absolute timeout for the blocking phase, NULL to wait forever
+ *
+ * @param[out]
+ * wakemode IMAGE_SEMWAIT_SPIN or IMAGE_SEMWAIT_BLOCK, may be NULL
+ *
+ * \returns same as ImageStreamIO_semwait / ImageStreamIO_semtimedwait
+ */
+int ImageStreamIO_semspinwait(
+    IMAGE *image,  ///< [in] the name of the shared memory file
+    int index,     ///< [in] semaphore index
+    long spinns,   ///< [in] spin budget [ns]
+    const struct timespec *semwts, ///< [in] absolute timeout, or NULL
+    int *wakemode  ///< [out] how the wait returned
+);
+
+/** @brief Wait on semaphores of several streams
+ *
+ * ## Purpose
+ *
+ * Block until at least one of the n semaphores is posted, then consume
+ * every one that is. Uses a single futex_waitv call when all streams
+ * are created with IMAGE_OPT_FUTEX, polling otherwise.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * images	IMAGE**
+ * 			array of n pointers to shmim
+ *
+ * @param[in]
+ * semindex semaphore index for each shmim
+ *
+ * @param[in]
+ * n        number of shmims
+ *
+ * @param[in]
+ * semwts   absolute timeout (CLOCK_REALTIME), NULL to wait forever
+ *
+ * @param[out]
+ * fired    array of n flags, set to 1 for each semaphore consumed,
+ *          -1 for a stream remapped onto its re-created stream
+ *
+ * \returns number of semaphores consumed, -1 with errno set (ETIMEDOUT, EINTR, EINVAL) otherwise.
+ * -1 with errno ESTALE if a stream was re-created: images[i] with fired[i] == -1
+ * is remapped (see ImageStreamIO_semwait), semaphores with fired[i] == 1 were consumed.
+ */
+int ImageStreamIO_semwait_any(
+    IMAGE **images, ///< [in] array of n shmims
+    int *semindex,  ///< [in] semaphore index for each shmim
+    int n,          ///< [in] number of shmims
+    const struct timespec *semwts, ///< [in] absolute timeout, or NULL
+    int *fired      ///< [out] 1 for each semaphore consumed
+);
+
+
 /** @brief Flush all semaphores of a shmim
  *
  * ## Purpose
@@ -501,14 +850,286 @@ long ImageStreamIO_semvalue(
     long index); // Warning returns in-band error if semID is bad.
 
 
+/** @brief Start image update
+ *
+ * Sets md->write, ordered before the frame data stores.
+ * Call before writing a frame, then ImageStreamIO_UpdateIm once done.
+ * For temporal circular buffers, also clears the cntarray entry of the
+ * slice about to be written, so readers see it is being overwritten.
+ */
+long ImageStreamIO_BeginUpdateIm(
+    IMAGE *image
+);
+
+/** @brief Publish image update
+ *
+ * Updates circular buffer, increments md->cnt0 and clears md->write
+ * (release ordering), then posts all semaphores.
+ */
 long ImageStreamIO_UpdateIm(
     IMAGE *image
 );
 
 
+/** @brief Publish slice of temporal circular buffer
+ *
+ * For CIRCULAR_BUFFER | ZAXIS_TEMPORAL streams, single writer. Write the
+ * slice at ImageStreamIO_writeBuffer (after ImageStreamIO_BeginUpdateIm),
+ * then commit: fills atimearray, writetimearray and cntarray for the
+ * slice, advances md->cnt1 to it, then calls ImageStreamIO_UpdateIm.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG if stream is not a temporal circular buffer
+ */
+long ImageStreamIO_commitSlice(
+    IMAGE *image,                 ///< [in] the shared memory image
+    const struct timespec *atime  ///< [in] acquisition time of slice, NULL for write time
+);
+
+
+/** @brief Reserve slice of temporal circular buffer, multi-producer
+ *
+ * For CIRCULAR_BUFFER | ZAXIS_TEMPORAL streams written by several threads
+ * or processes. Claims a ticket from md->CBticket and returns the slice to
+ * fill. Waits while the slice still holds a frame not yet published, or
+ * the latest published frame (md->cnt1, still read), i.e. while producers
+ * are size[2] - 1 slices ahead of the oldest uncommitted ticket.
+ * Every reserved ticket must be committed, or publishing stalls. If the
+ * producer holding the oldest ticket died, a producer waiting here
+ * commits that slice zero-filled and counts it in md->slicelostcnt, so
+ * publishing resumes. A producer dying between claiming its ticket and
+ * returning from this call is not detected.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG if stream is not a temporal circular buffer
+ */
+errno_t ImageStreamIO_reserveSlice(
+    IMAGE *image,      ///< [in] the shared memory image
+    uint64_t *ticket,  ///< [out] ticket, pass to ImageStreamIO_commitReservedSlice
+    void **buffer      ///< [out] slice to fill
+);
+
+/** @brief Commit slice reserved with ImageStreamIO_reserveSlice
+ *
+ * Slices may be committed out of order, readers see them in ticket order:
+ * md->cnt1 / md->cnt0 (and semaphore posts) advance over consecutive
+ * committed slices only. No lock is waited on.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG if stream is not a temporal circular buffer
+ */
+errno_t ImageStreamIO_commitReservedSlice(
+    IMAGE *image,                 ///< [in] the shared memory image
+    uint64_t ticket,              ///< [in] ticket from ImageStreamIO_reserveSlice
+    const struct timespec *atime  ///< [in] acquisition time of slice, NULL for commit time
+);
+
+
+#define IMAGE_READ_CONSISTENT_MAXTRY     100         /**< ImageStreamIO_read_consistent copy attempts before giving up */
+#define IMAGE_READ_CONSISTENT_MAXWAIT_NS 1000000000L /**< ImageStreamIO_read_consistent wait for writer [ns] before giving up */
+
+/** @brief Copy frame, guaranteed not torn by a concurrent update
+ *
+ * ## Purpose
+ *
+ * Seqlock-style read on md->cnt0 and md->write: the frame is copied to
+ * dst and the copy is retried if the writer updated it meanwhile.
+ * CPU streams only.
+ *
+ * ## Arguments
+ *
+ * @param[in]
+ * image	IMAGE*
+ * 			pointer to shmim
+ *
+ * @param[out]
+ * dst      destination buffer, md->imdatamemsize bytes
+ *
+ * @param[out]
+ * cnt0     md->cnt0 of the frame copied, may be NULL
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_FAILURE (errno EAGAIN) if
+ * no consistent copy after IMAGE_READ_CONSISTENT_MAXTRY attempts or
+ * writer busy for longer than IMAGE_READ_CONSISTENT_MAXWAIT_NS,
+ * IMAGESTREAMIO_NOTIMPL for GPU streams
+ */
+errno_t ImageStreamIO_read_consistent(
+    IMAGE *image,  ///< [in] the shared memory image
+    void *dst,     ///< [out] destination buffer
+    uint64_t *cnt0 ///< [out] frame counter, or NULL
+);
+
+/** @brief Get past frame from fast circular buffer by frame counter
+ *
+ * ## Purpose
+ *
+ * ImageStreamIO_UpdateIm stamps each circular buffer slot with the
+ * CBFRAMEMD (cnt0, cnt1, atime, writetime) of the frame it holds.
+ * Locates frame cnt0 in O(1), returns a pointer to its data in the
+ * circular buffer and a copy of its metadata. Data is not copied: check
+ * with ImageStreamIO_CB_check once done reading it.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_FAILURE with errno
+ * EAGAIN if frame is not published yet or ENOENT if it is no longer in
+ * the buffer, IMAGESTREAMIO_INVALIDARG if stream has no circular buffer
+ */
+errno_t ImageStreamIO_CB_get(
+    IMAGE *image,       ///< [in] the shared memory image
+    uint64_t cnt0,      ///< [in] frame counter
+    void **ptr,         ///< [out] frame data, or NULL
+    CBFRAMEMD *framemd  ///< [out] frame metadata, or NULL
+);
+
+/** @brief Check circular buffer frame was not overwritten
+ *
+ * \returns 1 if data read so far at ptr (from ImageStreamIO_CB_get) is
+ * still frame cnt0, 0 if writer overwrote the slot
+ */
+int ImageStreamIO_CB_check(
+    IMAGE *image,       ///< [in] the shared memory image
+    uint64_t cnt0,      ///< [in] frame counter passed to ImageStreamIO_CB_get
+    const void *ptr     ///< [in] frame data returned by ImageStreamIO_CB_get
+);
+
+/** @brief Attach reader cursor to temporal circular buffer stream
+ *
+ * ## Purpose
+ *
+ * For CIRCULAR_BUFFER | ZAXIS_TEMPORAL streams. The cursor remembers the
+ * cnt0 of the last slice consumed, and finds slices written since from
+ * md->cnt1 (last slice written) and cntarray (cnt0 of each slice), so
+ * frames missed while semaphores were saturated are not lost track of.
+ * Writers must set cntarray[slice] to the slice cnt0 before updating
+ * md->cnt1, one cnt0 increment per slice.
+ *
+ * Cursor starts at the latest slice: only slices written after this
+ * call are returned. Set cursor->cnt0 to 0 to also get the backlog.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG if stream is not a temporal circular buffer
+ */
+errno_t ImageStreamIO_cursor_init(
+    IMAGE_CURSOR *cursor, ///< [out] reader cursor
+    IMAGE *image          ///< [in] the shared memory image
+);
+
+/** @brief Get next slice after cursor
+ *
+ * \returns 1 and advances cursor if a slice is available, 0 if none.
+ * nblost is set to the number of frames overwritten before they could be
+ * consumed, skipped to reach the oldest slice still in the buffer.
+ */
+int ImageStreamIO_cursor_next(
+    IMAGE_CURSOR *cursor, ///< [in,out] reader cursor
+    uint32_t *slice,      ///< [out] slice index
+    uint64_t *nblost      ///< [out] frames lost to overrun, or NULL
+);
+
+/** @brief Get all slices written since cursor
+ *
+ * Backlog is returned as up to two ranges of slices contiguous in memory
+ * (two when it wraps around the end of the buffer), oldest first, and
+ * cursor moves to the latest slice. At most size[2] - 1 slices are
+ * returned: the oldest slice of a full buffer is the writer's next one.
+ *
+ * \returns number of ranges filled (0, 1 or 2)
+ */
+int ImageStreamIO_cursor_drain(
+    IMAGE_CURSOR *cursor,     ///< [in,out] reader cursor
+    IMAGE_SLICERANGE range[2],///< [out] slice ranges
+    uint64_t *nblost          ///< [out] frames lost to overrun, or NULL
+);
+
+/** @brief Check slice returned by cursor was not overwritten
+ *
+ * Slices are not copied: once done reading one, check that the writer
+ * did not overwrite it meanwhile. The slice cnt0 is cursor->cnt0 after
+ * ImageStreamIO_cursor_next, range cnt0 plus offset for _drain.
+ *
+ * \returns 1 if data read so far is still frame cnt0, 0 otherwise
+ */
+int ImageStreamIO_cursor_check(
+    IMAGE_CURSOR *cursor, ///< [in] reader cursor
+    uint32_t slice,       ///< [in] slice index
+    uint64_t cnt0         ///< [in] frame counter of slice
+);
+
+/** @brief Append batch of events to event ring stream
+ *
+ * For shared _DATATYPE_EVENT_UI8_UI8_UI16_UI8 streams: the data array is a
+ * ring of md->nelement events, md->cnt2 counts events appended since
+ * creation, and md->cnt0 counts batches. Batch metadata (first event,
+ * size, times) is kept for the last IMAGE_EVENT_NBBATCH batches.
+ * Single writer; the oldest events are overwritten, readers never block it.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_INVALIDARG if not an event ring stream or batch too large
+ */
+errno_t ImageStreamIO_event_append(
+    IMAGE *image,                          ///< [in] the shared memory image
+    const EVENT_UI8_UI8_UI16_UI8 *events,  ///< [in] events to append
+    uint64_t nevent,                       ///< [in] number of events, at most md->nelement
+    const struct timespec *atime           ///< [in] acquisition time of batch, NULL for append time
+);
+
+/** @brief Read events appended since event index *since
+ *
+ * Lock-free: events overwritten by the writer before or during the copy
+ * are skipped and reported in *nblost. *since is advanced past the events
+ * returned.
+ *
+ * \returns number of events copied to dst
+ */
+uint64_t ImageStreamIO_event_read(
+    IMAGE *image,                  ///< [in] the shared memory image
+    uint64_t *since,               ///< [in,out] index of next event to read
+    EVENT_UI8_UI8_UI16_UI8 *dst,   ///< [out] room for maxevent events
+    uint64_t maxevent,             ///< [in] maximum number of events to read
+    uint64_t *nblost               ///< [out] events lost to overrun, or NULL
+);
+
+/** @brief Get metadata of event batch cnt0
+ *
+ * \returns IMAGESTREAMIO_SUCCESS, IMAGESTREAMIO_FAILURE with errno EAGAIN if
+ * not published yet or ENOENT if no longer held, IMAGESTREAMIO_INVALIDARG
+ */
+errno_t ImageStreamIO_event_batch(
+    IMAGE *image,             ///< [in] the shared memory image
+    uint64_t cnt0,            ///< [in] batch counter
+    IMAGE_EVENTBATCH *batch   ///< [out] batch metadata
+);
+
+///@}
 
+/* =============================================================================================== */
+/* =============================================================================================== */
+/** @name ImageStreamIO - 3. STREAM REGISTRY                                                       */
+/**@{                                                                                              */
+/* =============================================================================================== */
+/* =============================================================================================== */
 
+/** @brief Look up stream in registry
+ *
+ * The registry (IMAGE_REGISTRY_FILENAME in the shm directory) is updated
+ * by ImageStreamIO_createIm_gpu and ImageStreamIO_destroyIm. Looking up a
+ * stream is a memory scan, no file is opened once the registry is mapped.
+ * Streams whose files were removed without ImageStreamIO_destroyIm are
+ * still listed; compare entry inode with the file to detect them.
+ *
+ * \returns IMAGESTREAMIO_SUCCESS if found, IMAGESTREAMIO_FAILURE if not,
+ * IMAGESTREAMIO_FILEOPEN if registry is unavailable
+ */
+errno_t ImageStreamIO_registry_lookup(
+    const char *name,           ///< [in] stream name
+    IMAGE_REGISTRY_ENTRY *entry ///< [out] registry entry, or NULL
+);
 
+/** @brief List streams in registry
+ *
+ * Copies up to maxentries entries of existing streams.
+ *
+ * \returns number of streams in registry (may exceed maxentries), -1 if
+ * registry is unavailable
+ */
+long ImageStreamIO_registry_list(
+    IMAGE_REGISTRY_ENTRY *entries, ///< [out] array of maxentries entries, or NULL
+    long maxentries                ///< [in] size of entries array
+);
 
 ///@}
 
@@ -18,7 +18,7 @@
 #ifndef _IMAGESTRUCT_H
 #define _IMAGESTRUCT_H
 
-#define IMAGESTRUCT_VERSION "1.05"
+#define IMAGESTRUCT_VERSION "1.18"
 
 #define STRINGMAXLEN_IMAGE_NAME          80
 #define STRINGMAXLEN_FILE_NAME          200
@@ -33,6 +33,10 @@
 // number of entries in write history
 #define IMAGESTRUCT_FRAMEWRITEMDSIZE 100
 
+// cache line size, shared stream arrays and writer-hot metadata are aligned to it
+#define IMAGE_CACHELINE_SIZE 64
+#define IMAGE_CACHELINE_ALIGNED __attribute__((aligned(IMAGE_CACHELINE_SIZE)))
+
 
 #include <semaphore.h>
 #include <stdint.h>
@@ -117,7 +121,7 @@ extern "C" {
 #define _DATATYPE_COMPLEX_DOUBLE                      12  /**< complex double */
 #define SIZEOF_DATATYPE_COMPLEX_DOUBLE                16
 
-#define _DATATYPE_EVENT_UI8_UI8_UI16_UI8              20
+#define _DATATYPE_EVENT_UI8_UI8_UI16_UI8              20  /**< event record, see EVENT_UI8_UI8_UI16_UI8. Data array is an event ring */
 #define SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8         5
 
 #define Dtype                                          9   /**< default data type for floating point */
@@ -131,6 +135,7 @@ extern "C" {
 // written by writer to control readers
 // IMAGE.semctrl
 #define IMAGE_SEMAPHORE_CONTROL_READY          0x00000001 /**< Semaphore ready for semwait. If 0, exit semwait calls until back to 1. This flag is used to notify readers that semaphores are going to be destroyed or re-created, or to pause readers for other reasons */
+#define IMAGE_RECONNECT_POLL_NS                1000000    /**< reader poll interval [ns] while its semaphore is not ready, see ImageStreamIO_reconnect */
 
 // semaphores status
 // written by readers to communicate real-time status back to stream
@@ -139,6 +144,22 @@ extern "C" {
 #define IMAGE_SEMAPHORE_STATUS_SEMWAIT         0x00000002  /**< semaphore is being waited for by PID */
 #define IMAGE_SEMAPHORE_STATUS_SEMREADYWAIT    0x00000004  /**< PID waiting for semaphore to be ready */
 #define IMAGE_SEMAPHORE_STATUS_SEMTIMEOUT      0x00000008  /**< PID semwait timed out */
+#define IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED    0x00000010  /**< PID must not lose frames, writer flow policy applies, see ImageStreamIO_flowcontrol */
+
+// reader semaphore index lease
+// IMAGE.semreader[].lease
+#define IMAGE_SEMLEASE_NS  5000000000ULL  /**< lease duration [ns], PID of reader with older lease is probed before reclaiming its semaphore */
+
+// writer flow control, applied to readers with IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED
+// IMAGE_METADATA.flowpolicy
+#define IMAGE_FLOW_OVERWRITE   0  /**< writer never waits, slow readers lose frames (default) */
+#define IMAGE_FLOW_BLOCK       1  /**< writer waits until slowest required reader catches up */
+#define IMAGE_FLOW_DROP        2  /**< writer skips frame and counts it in md->flowdropcnt */
+#define IMAGE_FLOW_POLL_NS     20000  /**< IMAGE_FLOW_BLOCK writer poll interval [ns] */
+
+// multi-producer temporal circular buffer, see ImageStreamIO_reserveSlice
+// IMAGE.cntarray
+#define IMAGE_SLICE_RESERVED   0x8000000000000000ULL  /**< cntarray of slice reserved and not committed, OR'ed with producer PID */
 
 
 // Type of stream
@@ -156,6 +177,39 @@ extern "C" {
 #define ZAXIS_WAVELENGTH 0x30000  /**< wavelength coordinate */
 #define ZAXIS_MAPPING    0x40000  /**< mapping index */
 
+// Stream options
+// OR-ed into imagetype at image creation, kept in IMAGE_METADATA.imagetype
+
+#define IMAGE_OPT_FUTEX      0x0000000100000000ULL  /**< semaphores are futex words inside the stream, no named semaphores */
+#define IMAGE_OPT_BROADCAST  0x0000000200000000ULL  /**< sempost(-1) posts connected readers only, single wake call (implies IMAGE_OPT_FUTEX) */
+#define IMAGE_OPT_HUGEPAGE   0x0000000400000000ULL  /**< huge page backed stream (hugetlbfs or THP), data and CB data aligned to huge page size */
+#define IMAGE_OPT_CBZEROCOPY 0x0000000800000000ULL  /**< frames written in place into CB slots, no CB copy; array.raw is the slot being written, latest frame from ImageStreamIO_get_latest_ptr (CPU, CBsize >= 2) */
+#define IMAGE_OPT_CBDEFERRED 0x0000001000000000ULL  /**< ImageStreamIO_UpdateIm publishes frame and posts semaphores before copying it into the CB (no effect without CB) */
+#define IMAGE_OPT_REUSE      0x0000002000000000ULL  /**< create re-uses existing shared CPU stream of same name and layout: counters reset in place, data, semaphores and readers kept */
+#define IMAGE_OPT_POPULATE   0x0000004000000000ULL  /**< stream mapped with MAP_POPULATE, by creator and every process opening it */
+#define IMAGE_OPT_MLOCK      0x0000008000000000ULL  /**< stream mapping locked in memory (mlock), by creator and every process opening it */
+#define IMAGE_OPT_PRETOUCH   0x0000010000000000ULL  /**< stream pages touched by the creating / opening thread, allocated on its NUMA node */
+#define IMAGE_OPT_NUMABIND   0x0000020000000000ULL  /**< data (shared CPU stream) bound to NUMA node IMAGE_OPT_NUMANODE(node) with mbind */
+#define IMAGE_OPT_NUMAINTERLEAVE 0x0000040000000000ULL  /**< data (shared CPU stream) interleaved over all NUMA nodes with mbind */
+#define IMAGE_OPT_NUMACB     0x0000080000000000ULL  /**< NUMA policy also applies to circular buffer data (always with IMAGE_OPT_CBZEROCOPY) */
+
+// NUMA node for IMAGE_OPT_NUMABIND, OR-ed into imagetype
+#define IMAGE_OPT_NUMANODE_MASK  0x00FF000000000000ULL
+#define IMAGE_OPT_NUMANODE_SHIFT 48
+#define IMAGE_OPT_NUMANODE(node) (((uint64_t)(node) << IMAGE_OPT_NUMANODE_SHIFT) & IMAGE_OPT_NUMANODE_MASK)
+
+// NUMA placement of stream data achieved at creation
+// IMAGE_METADATA.numapolicy
+#define IMAGE_NUMA_DEFAULT     0  /**< no policy, pages allocated on node of first touch */
+#define IMAGE_NUMA_BIND        1  /**< data bound to node IMAGE_METADATA.numanode */
+#define IMAGE_NUMA_INTERLEAVE  2  /**< data interleaved over all nodes */
+
+// Stream memory preparation achieved, see IMAGE_OPT_POPULATE, IMAGE_OPT_MLOCK, IMAGE_OPT_PRETOUCH
+// IMAGE_METADATA.memstatus (creator), IMAGE.memstatus (this process)
+#define IMAGE_MEMSTATUS_POPULATED  0x00000001  /**< page tables populated at map time */
+#define IMAGE_MEMSTATUS_LOCKED     0x00000002  /**< mapping locked in memory */
+#define IMAGE_MEMSTATUS_PRETOUCHED 0x00000004  /**< every page touched by mapping thread */
+
 /** @brief  Keyword
  * The IMAGE_KEYWORD structure includes :
  * 	- name
@@ -203,6 +257,18 @@ typedef struct
     double im;
 } complex_double;
 
+/** @brief event record, _DATATYPE_EVENT_UI8_UI8_UI16_UI8
+ *
+ * Packed, SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8 bytes.
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t  x;  /**< pixel x coordinate */
+    uint8_t  y;  /**< pixel y coordinate */
+    uint16_t t;  /**< time stamp, relative to batch atime */
+    uint8_t  p;  /**< polarity */
+} EVENT_UI8_UI8_UI16_UI8;
+
 
 
 
@@ -287,7 +353,8 @@ typedef struct
      *    3: wavelength coordinate
      *    4: mapping index
      *
-     *
+     * 0x 0000 0XXX 0000 0000  stream options, see IMAGE_OPT_XXX defines
+     * 0x 00XX 0000 0000 0000  NUMA node for IMAGE_OPT_NUMABIND, see IMAGE_OPT_NUMANODE
      *
      */
 
@@ -304,13 +371,6 @@ typedef struct
     // absolute timers using struct timespec
 
     struct timespec creationtime;
-    struct timespec lastaccesstime;
-
-    // time at which data was acquires/created. This time CAN be copied from input to output
-    struct timespec atime;
-
-    // last write time into data array
-    struct timespec writetime;
 
 
     pid_t creatorPID;  /**< PID of process that created the stream (if shared = 1) */
@@ -332,20 +392,38 @@ typedef struct
     uint16_t sem;                      /**< number of semaphores supported, specified at image creation      */
     uint16_t NBproctrace;              /**< number of streamproctrace entries */
 
+    uint16_t NBkw;                  /**< number of keywords (max: 65536)                                              */
+
+    uint32_t CBsize;    // fast circular memory buffer size, 0 if no CB allocated
 
-    uint64_t : 0; // align array to 8-byte boundary for speed
+    uint64_t imdatamemsize; // image size [bytes]
+
+    cudaIpcMemHandle_t cudaMemHandle;
+
+    uint64_t hugepagesize;  /**< huge page size data and CB data are aligned to, 0 if IMAGE_OPT_HUGEPAGE not set */
 
+    uint8_t  flowpolicy;    /**< writer flow control, see IMAGE_FLOW_XXX */
+
+    uint32_t memstatus;     /**< memory preparation achieved by creator, see IMAGE_MEMSTATUS_XXX */
+
+    uint8_t  numapolicy;    /**< NUMA placement of data, see IMAGE_NUMA_XXX */
+    int16_t  numanode;      /**< NUMA node data is bound to, -1 if not bound */
+
+
+    // Fields above are set at creation and read-mostly.
+    // Fields below are written by the writer on every frame, they start
+    // on their own cache line so that readers of the fields above do not
+    // share lines with frame updates.
+
+    IMAGE_CACHELINE_ALIGNED
     uint64_t cnt0;               	/**< counter (incremented if image is updated)                                    */
     uint64_t cnt1;               	/**< in 3D rolling buffer image, this is the last slice written                   */
     uint64_t cnt2;                  /**< in event mode, this is the # of events                                       */
+    uint64_t cnt2next;              /**< in event mode, cnt2 once batch being appended is published                   */
 
     uint8_t  write;               	/**< 1 if image is being written                                                  */
 
-
-    uint16_t NBkw;                  /**< number of keywords (max: 65536)                                              */
-
     // fast circular memory buffer
-    uint32_t CBsize;    // 0 if no CB allocated
     uint32_t CBindex;   // current index within buffer
     uint64_t CBcycle;   // number of buffer cycles
 
@@ -355,9 +433,24 @@ typedef struct
     uint64_t wCBcycle;
 #endif
 
-    uint64_t imdatamemsize; // image size [bytes]
+    struct timespec lastaccesstime;
 
-    cudaIpcMemHandle_t cudaMemHandle;
+    // time at which data was acquires/created. This time CAN be copied from input to output
+    struct timespec atime;
+
+    // last write time into data array
+    struct timespec writetime;
+
+    uint64_t flowdropcnt;   /**< frames skipped by writer, IMAGE_FLOW_DROP policy */
+
+    // multi-producer temporal circular buffer, see ImageStreamIO_reserveSlice
+    // contended by producers only, on its own cache line
+    IMAGE_CACHELINE_ALIGNED
+    uint64_t CBticket;    /**< next slice ticket, frame cnt0 = ticket + 1 */
+    pid_t    publishPID;  /**< PID of producer advancing cnt0 / cnt1 over committed slices, 0 if none */
+    uint64_t slicelostcnt; /**< reserved slices of producers that died before commit, published zero-filled */
+
+    // struct size is a multiple of IMAGE_CACHELINE_SIZE: data array starts on its own line
 
 } IMAGE_METADATA;
 
@@ -407,6 +500,52 @@ typedef struct
 } FRAMEWRITEMD;
 
 
+#define IMAGE_EVENT_NBBATCH 1024 /**< event ring streams: number of batch metadata entries kept */
+
+/** @brief Event batch metadata
+ *
+ * Event ring streams (_DATATYPE_EVENT_UI8_UI8_UI16_UI8) keep one entry per
+ * appended batch. Batch cnt0 is held in entry cnt0 % IMAGE_EVENT_NBBATCH,
+ * see ImageStreamIO_event_append.
+ */
+typedef struct
+{
+    uint64_t cnt0;              /**< md->cnt0 of batch, 0 while entry is rewritten */
+    uint64_t evstart;           /**< md->cnt2 before batch: index of first event */
+    uint64_t nevent;            /**< number of events in batch */
+    struct timespec atime;      /**< batch acquisition time */
+    struct timespec writetime;  /**< batch append time */
+} IMAGE_EVENTBATCH;
+
+
+
+
+
+/** @brief SEMFUTEX counting semaphore held in the stream
+ *
+ * Used instead of named semaphores when the stream is created with IMAGE_OPT_FUTEX.
+ * value is the futex word, nwaiters lets posters skip the wake syscall when nobody sleeps.
+ * Each semaphore has its own cache line, readers do not contend with each other.
+ */
+typedef struct
+{
+    uint32_t value;     /**< semaphore value (0 to SEMAPHORE_MAXVAL) */
+    uint32_t nwaiters;  /**< number of threads blocked on value */
+    uint8_t  pad[IMAGE_CACHELINE_SIZE - 2 * sizeof(uint32_t)]; /**< one cache line per semaphore */
+} SEMFUTEX;
+
+
+/** @brief Reader slot of a semaphore index, written by the reader holding it
+ *
+ * Readers report their position every frame. Each slot has its own cache
+ * line, readers do not contend with each other.
+ */
+typedef struct
+{
+    uint64_t cnt0;   /**< cnt0 of last frame consumed, see ImageStreamIO_flow_consumed */
+    uint64_t lease;  /**< lease time (CLOCK_MONOTONIC [ns]), renewed when waiting on the index */
+    uint8_t  pad[IMAGE_CACHELINE_SIZE - 2 * sizeof(uint64_t)]; /**< one cache line per reader */
+} SEMREADER;
 
 
 
@@ -419,6 +558,44 @@ typedef struct
 
 
 
+// Stream registry
+// table of existing streams, shared by all processes using the same shm directory
+// maintained by ImageStreamIO_createIm_gpu and ImageStreamIO_destroyIm
+
+#define IMAGE_REGISTRY_FILENAME  "isio_registry.shm"  /**< registry file name in shm directory */
+#define IMAGE_REGISTRY_VERSION   "1.00"
+#define IMAGE_REGISTRY_NBENTRY   4096                 /**< number of registry entries, power of 2 */
+
+#define IMAGE_REGISTRY_FREE      0  /**< entry never used */
+#define IMAGE_REGISTRY_USED      1  /**< entry describes an existing stream */
+#define IMAGE_REGISTRY_REMOVED   2  /**< stream destroyed, entry kept for lookup and createcnt */
+
+/** @brief Stream registry entry
+ *
+ * Entries are looked up by stream name hash (open addressing, linear probing).
+ */
+typedef struct
+{
+    uint32_t state;                         /**< IMAGE_REGISTRY_XXX */
+    uint32_t seq;                           /**< odd while entry is being updated */
+    char     name[STRINGMAXLEN_IMAGE_NAME]; /**< stream name */
+    ino_t    inode;                         /**< inode of stream file */
+    uint64_t memsize;                       /**< size of stream file */
+    uint8_t  datatype;                      /**< data type code, see _DATATYPE_XXX */
+    pid_t    creatorPID;                    /**< PID of process that created the stream */
+    int64_t  createcnt;                     /**< number of times stream was (re-)created */
+} IMAGE_REGISTRY_ENTRY;
+
+typedef struct
+{
+    char     version[32];                   /**< IMAGE_REGISTRY_VERSION */
+    uint32_t nbentry;                       /**< IMAGE_REGISTRY_NBENTRY once initialized, 0 before */
+    pid_t    lockPID;                       /**< PID of process updating the registry, 0 if none */
+    IMAGE_REGISTRY_ENTRY entry[IMAGE_REGISTRY_NBENTRY];
+} IMAGE_REGISTRY;
+
+
+
 /** @brief IMAGE structure
  * The IMAGE structure includes :
  *   - an array of IMAGE_KEWORD structures
@@ -489,6 +666,8 @@ typedef struct /**< structure used to store data arrays                      */
         complex_float *CF;
         complex_double *CD;
 
+        EVENT_UI8_UI8_UI16_UI8 *EV;
+
     } array; /**< pointer to data array */
 
 
@@ -535,6 +714,7 @@ typedef struct /**< structure used to store data arrays                      */
     // Circular Buffer (CB) option
     // if CBsize>0, recent frames are memcpied in circular buffer
     // recent frames may be accessed in small CB for logging
+    // with IMAGE_OPT_CBZEROCOPY, array.raw points into CBimdata instead
 
     CBFRAMEMD * CircBuff_md; // circular buffer metadata
     void * CBimdata;         // data storage for circ buffer
@@ -544,9 +724,56 @@ typedef struct /**< structure used to store data arrays                      */
     FRAMEWRITEMD *writehist;
 #endif
 
+    // futex semaphores, md->sem entries followed by semlog and broadcast generation
+    // only used if stream created with IMAGE_OPT_FUTEX
+    SEMFUTEX *semfutex;
+
+    // reader slot for each semaphore: consumed position and lease
+    // written by reader holding the semaphore index
+    SEMREADER *semreader;
+
+    // frame copies of at least copyminsize bytes are split across copythreads
+    // threads, 0 or 1: single thread (process-local, see ImageStreamIO_set_copythreads)
+    int copythreads;
+    size_t copyminsize;
+
+    // event ring streams: batch metadata, IMAGE_EVENT_NBBATCH entries
+    // NULL for other streams
+    IMAGE_EVENTBATCH *eventbatch;
+
+    // memory preparation of this process mapping, see IMAGE_MEMSTATUS_XXX
+    uint32_t memstatus;
+
+    // md->sem when mapped, length of the semaphore arrays of this mapping
+    // (destroy sets md->sem to 0)
+    uint16_t semmapped;
+
 } IMAGE;
 
 
+
+/** @brief Reader cursor on temporal circular buffer stream
+ *
+ * Process-local. Tracks last frame consumed from a CIRCULAR_BUFFER | ZAXIS_TEMPORAL
+ * stream, see ImageStreamIO_cursor_init.
+ */
+typedef struct
+{
+    IMAGE   *image;
+    uint64_t cnt0;    /**< cnt0 of last slice consumed, 0 if none */
+    uint64_t nblost;  /**< total number of frames overwritten before being consumed */
+} IMAGE_CURSOR;
+
+/** @brief Range of slices contiguous in memory, returned by ImageStreamIO_cursor_drain
+ */
+typedef struct
+{
+    uint32_t slice;   /**< first slice index */
+    uint32_t nslice;  /**< number of slices */
+    uint64_t cnt0;    /**< cnt0 of first slice, following slices have cnt0+1, cnt0+2 ... */
+} IMAGE_SLICERANGE;
+
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -73,7 +73,8 @@ struct ImageStreamIODataType {
     DOUBLE = _DATATYPE_DOUBLE,
     COMPLEX_FLOAT = _DATATYPE_COMPLEX_FLOAT,
     COMPLEX_DOUBLE = _DATATYPE_COMPLEX_DOUBLE,
-    HALF = _DATATYPE_HALF
+    HALF = _DATATYPE_HALF,
+    EVENT_UI8_UI8_UI16_UI8 = _DATATYPE_EVENT_UI8_UI8_UI16_UI8
   };
   static const std::vector<uint8_t> Size;
 
@@ -92,7 +93,8 @@ const std::vector<uint8_t> ImageStreamIODataType::Size(
      SIZEOF_DATATYPE_INT16, SIZEOF_DATATYPE_UINT32, SIZEOF_DATATYPE_INT32,
      SIZEOF_DATATYPE_UINT64, SIZEOF_DATATYPE_INT64, SIZEOF_DATATYPE_FLOAT,
      SIZEOF_DATATYPE_DOUBLE, SIZEOF_DATATYPE_COMPLEX_FLOAT,
-     SIZEOF_DATATYPE_COMPLEX_DOUBLE, SIZEOF_DATATYPE_HALF});
+     SIZEOF_DATATYPE_COMPLEX_DOUBLE, SIZEOF_DATATYPE_HALF, 0, 0, 0, 0, 0, 0,
+     SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8});
 
 std::string ImageStreamIODataTypeToPyFormat(ImageStreamIODataType dt) {
   switch (dt.datatype) {
@@ -116,6 +118,8 @@ std::string ImageStreamIODataTypeToPyFormat(ImageStreamIODataType dt) {
       return py::format_descriptor<float>::format();
     case ImageStreamIODataType::DataType::DOUBLE:
       return py::format_descriptor<double>::format();
+    case ImageStreamIODataType::DataType::EVENT_UI8_UI8_UI16_UI8:
+      return py::format_descriptor<EVENT_UI8_UI8_UI16_UI8>::format();
     // case ImageStreamIODataType::DataType::COMPLEX_FLOAT: return
     // py::format_descriptor<(std::complex<float>>::format(); case
     // ImageStreamIODataType::DataType::COMPLEX_DOUBLE: return
@@ -183,10 +187,10 @@ py::array_t<T> convert_img(const IMAGE &img) {
   }
 
   auto ret_buffer = py::array_t<T>(shape, strides);
-  void *current_image = img.array.raw;
+  void *current_image = ImageStreamIO_get_latest_ptr(&img);
   size_t size_data = img.md->nelement * sizeof(T);
   if (img.md->location == -1) {
-    memcpy(ret_buffer.mutable_data(), current_image, size_data);
+    ImageStreamIO_copyframe_cached(&img, ret_buffer.mutable_data(), current_image, size_data);
   } else {
 #ifdef HAVE_CUDA
     cudaSetDevice(img.md->location);
@@ -201,7 +205,7 @@ py::array_t<T> convert_img(const IMAGE &img) {
 }
 
 template <typename T>
-void write(IMAGE &img,
+bool write(IMAGE &img,
            py::array_t<T, py::array::f_style | py::array::forcecast> b) {
   if (img.array.raw == nullptr) {
     throw std::runtime_error("image not initialized");
@@ -228,12 +232,17 @@ void write(IMAGE &img,
   uint8_t *buffer_ptr = (uint8_t *)info.ptr;
   uint64_t size = img.md->nelement * dt.asize;
 
-  img.md->write = 1;  // set this flag to 1 when writing data
+  // stream flow policy, frame skipped if required readers are too far behind
+  if (ImageStreamIO_flowcontrol(&img) != IMAGESTREAMIO_SUCCESS) {
+    return false;
+  }
+
+  ImageStreamIO_BeginUpdateIm(&img);  // set write flag when writing data
 
   void *current_image = img.array.raw;
 
   if (img.md->location == -1) {
-    memcpy(current_image, buffer_ptr, size);
+    ImageStreamIO_copyframe(&img, current_image, buffer_ptr, size);
   } else {
 #ifdef HAVE_CUDA
     cudaSetDevice(img.md->location);
@@ -243,16 +252,18 @@ void write(IMAGE &img,
         "unsupported location, CACAO needs to be compiled with -DUSE_CUDA=ON");
 #endif
   }
-  ImageStreamIO_sempost(&img, -1);
   clock_gettime(CLOCK_REALTIME, &img.md->lastaccesstime);
-  img.md->write = 0;  // Done writing data
-  img.md->cnt0++;
   img.md->cnt1++;
+  ImageStreamIO_UpdateIm(&img);  // Done writing data, post semaphores
+  return true;
 }
 
 PYBIND11_MODULE(ImageStreamIOWrap, m) {
   m.doc() = "CACAO ImageStreamIO python module";
 
+  // event record as numpy structured dtype
+  PYBIND11_NUMPY_DTYPE(EVENT_UI8_UI8_UI16_UI8, x, y, t, p);
+
   auto imageDatatype =
       py::class_<ImageStreamIODataType>(m, "ImageStreamIODataType")
           .def(py::init([](uint8_t datatype) {
@@ -282,6 +293,8 @@ PYBIND11_MODULE(ImageStreamIOWrap, m) {
       .value("DOUBLE", ImageStreamIODataType::DataType::DOUBLE)
       .value("COMPLEX_FLOAT", ImageStreamIODataType::DataType::COMPLEX_FLOAT)
       .value("COMPLEX_DOUBLE", ImageStreamIODataType::DataType::COMPLEX_DOUBLE)
+      .value("EVENT_UI8_UI8_UI16_UI8",
+             ImageStreamIODataType::DataType::EVENT_UI8_UI8_UI16_UI8)
       .export_values();
 
   auto imagetype =
@@ -467,6 +480,12 @@ PYBIND11_MODULE(ImageStreamIOWrap, m) {
       .def_readonly("cnt0", &IMAGE_METADATA::cnt0)
       .def_readonly("cnt1", &IMAGE_METADATA::cnt1)
       .def_readonly("cnt2", &IMAGE_METADATA::cnt2)
+      .def_readonly("flowpolicy", &IMAGE_METADATA::flowpolicy)
+      .def_readonly("flowdropcnt", &IMAGE_METADATA::flowdropcnt)
+      .def_readonly("slicelostcnt", &IMAGE_METADATA::slicelostcnt)
+      .def_readonly("memstatus", &IMAGE_METADATA::memstatus)
+      .def_readonly("numapolicy", &IMAGE_METADATA::numapolicy)
+      .def_readonly("numanode", &IMAGE_METADATA::numanode)
       .def_readonly("write", &IMAGE_METADATA::write)
       .def_readonly("flag", &IMAGE_METADATA::flag)
       .def_readonly("NBkw", &IMAGE_METADATA::NBkw)
@@ -771,6 +790,8 @@ PYBIND11_MODULE(ImageStreamIOWrap, m) {
                  return convert_img<float>(img);
                case ImageStreamIODataType::DataType::DOUBLE:
                  return convert_img<double>(img);
+               case ImageStreamIODataType::DataType::EVENT_UI8_UI8_UI16_UI8:
+                 return convert_img<EVENT_UI8_UI8_UI16_UI8>(img);
                // case ImageStreamIODataType::DataType::COMPLEX_FLOAT: return ;
                // case ImageStreamIODataType::DataType::COMPLEX_DOUBLE: return ;
                default:
@@ -780,81 +801,101 @@ PYBIND11_MODULE(ImageStreamIOWrap, m) {
 
       .def("write", &write<uint8_t>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<uint16_t>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<uint32_t>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<uint64_t>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<int8_t>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<int16_t>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<int32_t>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<int64_t>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<float>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
       .def("write", &write<double>,
            R"pbdoc(
-          Write into memory image stream
+          Write into memory image stream, applying stream flow policy
           Parameters:
             buffer [in]:  buffer to put into memory image stream
+          Return:
+            written [out]: False if frame dropped by flow policy
           )pbdoc",
            py::arg("buffer"))
 
@@ -1002,17 +1043,21 @@ PYBIND11_MODULE(ImageStreamIOWrap, m) {
 
       .def(
           "open",
-          [](IMAGE &img, std::string name) {
-            return ImageStreamIO_openIm(&img, name.c_str());
+          [](IMAGE &img, std::string name, bool lazysem, bool cached) {
+            return ImageStreamIO_openIm_flags(&img, name.c_str(),
+                                              (lazysem ? IMAGE_OPEN_LAZYSEM : 0) |
+                                              (cached ? IMAGE_OPEN_CACHED : 0));
           },
           R"pbdoc(
             Open / connect to existing shared memory image stream
             Parameters:
-                name   [in]:  the name of the shared memory file to connect
+                name    [in]:  the name of the shared memory file to connect
+                lazysem [in]:  attach semaphores on first use
+                cached  [in]:  share mapping with other cached opens of this process
             Return:
                 ret    [out]: error code
             )pbdoc",
-          py::arg("name"))
+          py::arg("name"), py::arg("lazysem") = false, py::arg("cached") = false)
 
       .def(
           "close",
@@ -1030,6 +1075,20 @@ PYBIND11_MODULE(ImageStreamIOWrap, m) {
                 ret    [out]: error code
             )pbdoc")
 
+      .def(
+          "reconnect",
+          [](IMAGE &img) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_reconnect(&img);
+          },
+          R"pbdoc(
+            Remap image onto stream re-created under the same name
+            Return:
+                ret    [out]: error code, failure if stream was not re-created
+            )pbdoc")
+
       .def(
           "destroy",
           [](IMAGE &img) {
@@ -1068,6 +1127,181 @@ PYBIND11_MODULE(ImageStreamIOWrap, m) {
             )pbdoc",
           py::arg("index"))
 
+      .def(
+          "set_copythreads",
+          [](IMAGE &img, int nbthread, size_t minsize) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_set_copythreads(&img, nbthread, minsize);
+          },
+          R"pbdoc(
+            Split large frame copies of this stream across threads
+
+            Parameters:
+                nbthread [in]:  threads per copy, 1: single thread, 0: one per NUMA node
+                minsize  [in]:  frame size [bytes] from which copies are split, 0: default
+            Return:
+                ret      [out]: error code
+            )pbdoc",
+          py::arg("nbthread"), py::arg("minsize") = 0)
+
+      .def(
+          "numa_pin",
+          [](IMAGE &img) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_numa_pin(&img);
+          },
+          R"pbdoc(
+            Pin calling thread to the NUMA node holding stream data
+
+            Return:
+                ret      [out]: error code
+            )pbdoc")
+
+      .def(
+          "event_append",
+          [](IMAGE &img, py::array_t<EVENT_UI8_UI8_UI16_UI8,
+                                     py::array::c_style> events) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_event_append(&img, events.data(),
+                                              events.size(), NULL);
+          },
+          R"pbdoc(
+            Append batch of events to event ring stream
+
+            Parameters:
+                events   [in]:  numpy array of event records (x, y, t, p)
+            Return:
+                ret      [out]: error code
+            )pbdoc",
+          py::arg("events"))
+
+      .def(
+          "event_read",
+          [](IMAGE &img, uint64_t since, uint64_t maxevent) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            if (maxevent == 0) {
+              maxevent = img.md->nelement;
+            }
+            py::array_t<EVENT_UI8_UI8_UI16_UI8> events(maxevent);
+            uint64_t nblost = 0;
+            uint64_t nevent = ImageStreamIO_event_read(
+                &img, &since, events.mutable_data(), maxevent, &nblost);
+            events.resize({(ssize_t)nevent});
+            return py::make_tuple(events, since, nblost);
+          },
+          R"pbdoc(
+            Read events appended to event ring stream since event index
+
+            Parameters:
+                since    [in]:  index of first event to read
+                maxevent [in]:  maximum number of events, 0: ring size
+            Return:
+                (events, since, nblost): numpy array of event records,
+                index of next event to read, number of events lost to overrun
+            )pbdoc",
+          py::arg("since"), py::arg("maxevent") = 0)
+
+      .def(
+          "set_flowpolicy",
+          [](IMAGE &img, uint8_t policy) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_set_flowpolicy(&img, policy);
+          },
+          R"pbdoc(
+            Set writer flow control policy of stream
+
+            Parameters:
+                policy   [in]:  0: overwrite, 1: block, 2: drop and count
+            Return:
+                ret      [out]: error code
+            )pbdoc",
+          py::arg("policy"))
+
+      .def(
+          "flow_register",
+          [](IMAGE &img, int semindex, int required) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_flow_register(&img, semindex, required);
+          },
+          R"pbdoc(
+            Declare reader as required by writer flow control
+
+            Parameters:
+                semindex [in]:  semaphore index held by reader
+                required [in]:  1 if reader must not lose frames
+            Return:
+                ret      [out]: error code
+            )pbdoc",
+          py::arg("semindex"), py::arg("required") = 1)
+
+      .def(
+          "flowcontrol",
+          [](IMAGE &img) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_flowcontrol(&img) == IMAGESTREAMIO_SUCCESS;
+          },
+          R"pbdoc(
+            Apply stream flow policy before writing next frame
+
+            Called by write(). Only needed by writers updating the
+            buffer directly.
+
+            Return:
+                ok       [out]: False if frame should be dropped
+            )pbdoc")
+
+      .def(
+          "flow_consumed",
+          [](IMAGE &img, int semindex, uint64_t cnt0) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_flow_consumed(&img, semindex, cnt0);
+          },
+          R"pbdoc(
+            Report last frame consumed by reader
+
+            Parameters:
+                semindex [in]:  semaphore index held by reader
+                cnt0     [in]:  cnt0 of last frame consumed
+            Return:
+                ret      [out]: error code
+            )pbdoc",
+          py::arg("semindex"), py::arg("cnt0"))
+
+      .def(
+          "releasesemwaitindex",
+          [](IMAGE &img, long index) {
+            if (img.array.raw == nullptr) {
+              throw std::runtime_error("image not initialized");
+            }
+            return ImageStreamIO_releasesemwaitindex(&img, index);
+          },
+          R"pbdoc(
+            Release shmim semaphore index claimed by this process
+
+            Parameters:
+                image	 [in]:  pointer to shmim (IMAGE)
+                index  [in]:  semaphore index
+            Return:
+                ret    [out]: error code
+            )pbdoc",
+          py::arg("index"))
+
       .def(
           "semwait",
           [](IMAGE &img, long index) {
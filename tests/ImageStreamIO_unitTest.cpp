@@ -1,4 +1,9 @@
+#include <thread>
+#include <vector>
 #include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 # ifdef USE_CFITSIO
@@ -14,6 +19,31 @@
 #define SHM_NAME_ImageTest SHM_NAME_PREFIX "ImageTest"
 #define SHM_NAME_CubeTest  SHM_NAME_PREFIX "CubeTest"
 #define SHM_NAME_LocnTest  SHM_NAME_PREFIX "LocationTest"
+#define SHM_NAME_FutexTest SHM_NAME_PREFIX "FutexTest"
+#define SHM_NAME_SpinTest  SHM_NAME_PREFIX "SpinTest"
+#define SHM_NAME_BcastTest SHM_NAME_PREFIX "BcastTest"
+#define SHM_NAME_AnyTestA  SHM_NAME_PREFIX "AnyTestA"
+#define SHM_NAME_AnyTestB  SHM_NAME_PREFIX "AnyTestB"
+#define SHM_NAME_LeaseTest SHM_NAME_PREFIX "LeaseTest"
+#define SHM_NAME_SeqTest   SHM_NAME_PREFIX "SeqTest"
+#define SHM_NAME_LazyTest  SHM_NAME_PREFIX "LazyTest"
+#define SHM_NAME_RegTest   SHM_NAME_PREFIX "RegistryTest"
+#define SHM_NAME_HugeTest  SHM_NAME_PREFIX "HugePageTest"
+#define SHM_NAME_LineTest  SHM_NAME_PREFIX "CacheLineTest"
+#define SHM_NAME_ZeroTest  SHM_NAME_PREFIX "ZeroCopyTest"
+#define SHM_NAME_CBGetTest SHM_NAME_PREFIX "CBGetTest"
+#define SHM_NAME_PoolTest  SHM_NAME_PREFIX "CopyPoolTest"
+#define SHM_NAME_CursorTest SHM_NAME_PREFIX "CursorTest"
+#define SHM_NAME_SliceTest SHM_NAME_PREFIX "SliceTest"
+#define SHM_NAME_TicketTest SHM_NAME_PREFIX "TicketTest"
+#define SHM_NAME_EventTest SHM_NAME_PREFIX "EventTest"
+#define SHM_NAME_FlowTest SHM_NAME_PREFIX "FlowTest"
+#define SHM_NAME_DeferTest SHM_NAME_PREFIX "DeferTest"
+#define SHM_NAME_ReuseTest SHM_NAME_PREFIX "ReuseTest"
+#define SHM_NAME_MemTest SHM_NAME_PREFIX "MemTest"
+#define SHM_NAME_NumaTest SHM_NAME_PREFIX "NumaTest"
+#define SHM_NAME_CacheTest SHM_NAME_PREFIX "CacheTest"
+#define SHM_NAME_ReconnectTest SHM_NAME_PREFIX "ReconnectTest"
 
 namespace {
 
@@ -26,6 +56,25 @@ namespace {
   int8_t gpuLocn =  0;   // Location of  0 => Pretend GPU-based shmim
   int8_t badLocn = -2;   // Location of -2 => bad location
 
+  // Default SIGCHLD action while in scope, so that the reaping handler
+  // installed by the Operations tests neither steals nor interrupts waits
+  struct SigchldDefault {
+    struct sigaction saved;
+    SigchldDefault() {
+      struct sigaction sa = {};
+      sa.sa_handler = SIG_DFL;
+      sigemptyset(&sa.sa_mask);
+      sigaction(SIGCHLD, &sa, &saved);
+    }
+    ~SigchldDefault() { sigaction(SIGCHLD, &saved, NULL); }
+  };
+
+  pid_t waitchild(pid_t pid, int *wstatus) {
+    pid_t rv;
+    while (((rv = waitpid(pid, wstatus, 0)) == -1) && (errno == EINTR)) { }
+    return rv;
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // ImageStreamIO utilities
 // - Finding the address of the start of data of interest
@@ -489,6 +538,7 @@ TEST(ImageStreamIOUtilities, Typesize) {
   UTSEE(SIZEOF_DATATYPE_DOUBLE,          _DATATYPE_DOUBLE,          8);
   UTSEE(SIZEOF_DATATYPE_COMPLEX_FLOAT,   _DATATYPE_COMPLEX_FLOAT,   8);
   UTSEE(SIZEOF_DATATYPE_COMPLEX_DOUBLE,  _DATATYPE_COMPLEX_DOUBLE, 16);
+  UTSEE(SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8, _DATATYPE_EVENT_UI8_UI8_UI16_UI8, 5);
   UTSEE(-1,                              _DATATYPE_UNINITIALIZED,  -1);
   UTSEE(-1,                              255,                      -1);
 # undef UTSEE
@@ -513,6 +563,7 @@ TEST(ImageStreamIOUtilities, Typename) {
   UTNEE("FLT64",   _DATATYPE_DOUBLE);
   UTNEE("CPLX32",  _DATATYPE_COMPLEX_FLOAT);
   UTNEE("CPLX64",  _DATATYPE_COMPLEX_DOUBLE);
+  UTNEE("EVENT",   _DATATYPE_EVENT_UI8_UI8_UI16_UI8);
   UTNEE("unknown", _DATATYPE_UNINITIALIZED);
   UTNEE("unknown", 255);
 # undef UTNEE
@@ -537,6 +588,7 @@ TEST(ImageStreamIOUtilities, Typename_7) {
   UT7EE("DOUBLE ",  _DATATYPE_DOUBLE);
   UT7EE("CFLOAT ",  _DATATYPE_COMPLEX_FLOAT);
   UT7EE("CDOUBLE",  _DATATYPE_COMPLEX_DOUBLE);
+  UT7EE("EVENT  ",  _DATATYPE_EVENT_UI8_UI8_UI16_UI8);
   UT7EE("unknown",  _DATATYPE_UNINITIALIZED);
   UT7EE("unknown",  255);
 # undef UT7EE
@@ -561,6 +613,7 @@ TEST(ImageStreamIOUtilities, TypenameShort) {
   UTSEE(" DBL",  _DATATYPE_DOUBLE);
   UTSEE("CFLT",  _DATATYPE_COMPLEX_FLOAT);
   UTSEE("CDBL",  _DATATYPE_COMPLEX_DOUBLE);
+  UTSEE(" EVT",  _DATATYPE_EVENT_UI8_UI8_UI16_UI8);
   UTSEE(" ???",  _DATATYPE_UNINITIALIZED);
   UTSEE(" ???",  255);
 # undef UTSEE
@@ -866,4 +919,1669 @@ TEST(ImageStreamIOTestOperations, CleanupTest) {
   EXPECT_EQ(sOK, isio_cleanup.file_cleanup_11(kill_child));
 }
 
+////////////////////////////////////////////////////////////////////////
+// Futex semaphores:  IMAGE_OPT_FUTEX streams hold semaphores in the shmim
+////////////////////////////////////////////////////////////////////////
+TEST(ImageStreamIOTestFutex, FutexSemaphores) {
+
+  IMAGE writer;
+  IMAGE reader;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_FutexTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 3, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_FutexTest));
+
+  // - No named semaphores are opened
+  EXPECT_EQ((sem_t**)NULL, reader.semptr);
+  EXPECT_EQ((sem_t*)NULL, reader.semlog);
+  EXPECT_EQ(3, reader.md->sem);
+
+  // - Post all, consume once, then semaphore is empty
+  ImageStreamIO_sempost(&writer, -1);
+  EXPECT_EQ(1, ImageStreamIO_semvalue(&reader, 0));
+  EXPECT_EQ(1, ImageStreamIO_semvalue(&reader, 2));
+  EXPECT_EQ(0, ImageStreamIO_semtrywait(&reader, 0));
+  EXPECT_EQ(-1, ImageStreamIO_semtrywait(&reader, 0));
+  EXPECT_EQ(EAGAIN, errno);
+
+  // - Value saturates at SEMAPHORE_MAXVAL, flush empties it
+  for (int i = 0; i < 2*SEMAPHORE_MAXVAL; ++i) {
+    ImageStreamIO_sempost(&writer, 1);
+  }
+  EXPECT_EQ(SEMAPHORE_MAXVAL, ImageStreamIO_semvalue(&reader, 1));
+  ImageStreamIO_semflush(&reader, 1);
+  EXPECT_EQ(0, ImageStreamIO_semvalue(&reader, 1));
+
+  // - Timed wait on an empty semaphore times out
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 10000000;
+  if (ts.tv_nsec >= 1000000000) { ts.tv_nsec -= 1000000000; ++ts.tv_sec; }
+  EXPECT_EQ(-1, ImageStreamIO_semtimedwait(&reader, 1, &ts));
+  EXPECT_EQ(ETIMEDOUT, errno);
+
+  // - Blocked reader is woken by a post from another thread
+  std::thread poster([&writer]() {
+    usleep(20000);
+    ImageStreamIO_sempost(&writer, 2);
+  });
+  ImageStreamIO_semflush(&reader, 2);
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += 5;
+  EXPECT_EQ(0, ImageStreamIO_semtimedwait(&reader, 2, &ts));
+  poster.join();
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+////////////////////////////////////////////////////////////////////////
+// Spin-then-block wait
+////////////////////////////////////////////////////////////////////////
+TEST(ImageStreamIOTestSpinWait, SpinThenBlock) {
+
+  IMAGE writer;
+  IMAGE reader;
+  int wakemode{0};
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_SpinTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_SpinTest));
+
+  // - Pending post is consumed right away
+  ImageStreamIO_UpdateIm(&writer);
+  EXPECT_EQ(0, ImageStreamIO_semspinwait(&reader, 0, 0, NULL, &wakemode));
+  EXPECT_EQ(IMAGE_SEMWAIT_SPIN, wakemode);
+
+  // - Update within the spin budget is caught while spinning
+  std::thread updater([&writer]() {
+    usleep(5000);
+    ImageStreamIO_UpdateIm(&writer);
+  });
+  EXPECT_EQ(0, ImageStreamIO_semspinwait(&reader, 0, 2000000000L, NULL
+                                        , &wakemode));
+  EXPECT_EQ(IMAGE_SEMWAIT_SPIN, wakemode);
+  updater.join();
+
+  // - No update within the spin budget: blocking wait times out
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 20000000;
+  if (ts.tv_nsec >= 1000000000) { ts.tv_nsec -= 1000000000; ++ts.tv_sec; }
+  EXPECT_EQ(-1, ImageStreamIO_semspinwait(&reader, 0, 1000, &ts, &wakemode));
+  EXPECT_EQ(IMAGE_SEMWAIT_BLOCK, wakemode);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestBroadcast, BroadcastPost) {
+
+  IMAGE writer;
+  IMAGE reader;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_BcastTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 4, 0
+                                      ,MATH_DATA | IMAGE_OPT_BROADCAST, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_BcastTest));
+
+  // - Broadcast implies futex semaphores
+  EXPECT_TRUE(reader.md->imagetype & IMAGE_OPT_FUTEX);
+
+  // - Semaphores without a reader are not posted
+  ImageStreamIO_sempost(&writer, -1);
+  for (int s = 0; s < 4; ++s) {
+    EXPECT_EQ(0, ImageStreamIO_semvalue(&reader, s));
+  }
+
+  // - A wait attempt connects the semaphore, further posts reach it
+  EXPECT_EQ(-1, ImageStreamIO_semtrywait(&reader, 1));
+  EXPECT_EQ(EAGAIN, errno);
+  EXPECT_TRUE(reader.semstatus[1] & IMAGE_SEMAPHORE_STATUS_CONNECTED);
+  ImageStreamIO_sempost(&writer, -1);
+  EXPECT_EQ(1, ImageStreamIO_semvalue(&reader, 1));
+  EXPECT_EQ(0, ImageStreamIO_semvalue(&reader, 2));
+  EXPECT_EQ(0, ImageStreamIO_semtrywait(&reader, 1));
+
+  // - Several blocked readers are woken by a single broadcast post
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += 5;
+  int rv[3] = {-1, -1, -1};
+  std::thread readers[3];
+  for (int i = 0; i < 3; ++i) {
+    readers[i] = std::thread([&reader, &ts, &rv, i]() {
+      rv[i] = ImageStreamIO_semtimedwait(&reader, i + 1, &ts);
+    });
+  }
+  // - Let all readers connect before posting
+  for (int i = 0; i < 1000; ++i) {
+    if ((reader.semstatus[1] & reader.semstatus[2] & reader.semstatus[3]
+         & IMAGE_SEMAPHORE_STATUS_CONNECTED)) { break; }
+    usleep(1000);
+  }
+  ImageStreamIO_sempost(&writer, -1);
+  for (int i = 0; i < 3; ++i) {
+    readers[i].join();
+    EXPECT_EQ(0, rv[i]);
+  }
+  EXPECT_EQ(0, ImageStreamIO_semvalue(&reader, 0));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestWaitAny, WaitAny) {
+
+  IMAGE streamA;
+  IMAGE streamB;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&streamA, SHM_NAME_AnyTestA
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&streamB, SHM_NAME_AnyTestB
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_BROADCAST, 0)
+           );
+
+  IMAGE* images[2] = {&streamA, &streamB};
+  int semindex[2] = {1, 1};
+  int fired[2] = {-1, -1};
+  struct timespec ts;
+
+  // - Nothing posted: timeout
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 10000000;
+  if (ts.tv_nsec >= 1000000000) { ts.tv_nsec -= 1000000000; ++ts.tv_sec; }
+  EXPECT_EQ(-1, ImageStreamIO_semwait_any(images, semindex, 2, &ts, fired));
+  EXPECT_EQ(ETIMEDOUT, errno);
+
+  // - Already posted: return right away, semaphore consumed
+  ImageStreamIO_sempost(&streamA, 1);
+  EXPECT_EQ(1, ImageStreamIO_semwait_any(images, semindex, 2, NULL, fired));
+  EXPECT_EQ(1, fired[0]);
+  EXPECT_EQ(0, fired[1]);
+  EXPECT_EQ(0, ImageStreamIO_semvalue(&streamA, 1));
+
+  // - Blocked waiter is woken by a post on either stream
+  for (int k = 0; k < 2; ++k) {
+    std::thread poster([&images, k]() {
+      usleep(20000);
+      ImageStreamIO_sempost(images[k], -1);
+    });
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 5;
+    EXPECT_EQ(1, ImageStreamIO_semwait_any(images, semindex, 2, &ts, fired));
+    EXPECT_EQ(1, fired[k]);
+    EXPECT_EQ(0, fired[1-k]);
+    poster.join();
+  }
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&streamB));
+
+  // - Named semaphore stream: polling fallback
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&streamB, SHM_NAME_AnyTestB
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA, 0)
+           );
+  ImageStreamIO_semflush(&streamB, -1);
+  std::thread poster([&streamB]() {
+    usleep(20000);
+    ImageStreamIO_sempost(&streamB, 1);
+  });
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += 5;
+  EXPECT_EQ(1, ImageStreamIO_semwait_any(images, semindex, 2, &ts, fired));
+  EXPECT_EQ(0, fired[0]);
+  EXPECT_EQ(1, fired[1]);
+  poster.join();
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&streamB));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&streamA));
+}
+
+TEST(ImageStreamIOTestLease, SemWaitIndex) {
+
+  IMAGE writer;
+  const int nbsem = 8;
+  const int nchild = 6;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_LeaseTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, nbsem, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+
+  // - Concurrent attaches, all asking for the same default index, get distinct indices
+  SigchldDefault sigchld;
+  int pipes[2];
+  ASSERT_EQ(0, pipe(pipes));
+  pid_t pids[nchild];
+  for (int c = 0; c < nchild; ++c) {
+    pids[c] = fork();
+    ASSERT_GE(pids[c], 0);
+    if (pids[c] == 0) {
+      IMAGE reader;
+      if (ImageStreamIO_openIm(&reader, SHM_NAME_LeaseTest)) { _exit(1); }
+      int semindex = ImageStreamIO_getsemwaitindex(&reader, 2);
+      if (write(pipes[1], &semindex, sizeof(semindex)) != sizeof(semindex)) { _exit(1); }
+      // keep holding the index until parent has read all of them
+      usleep(200000);
+      _exit(0);
+    }
+  }
+  close(pipes[1]);
+  int claimed[nbsem] = {0};
+  for (int c = 0; c < nchild; ++c) {
+    int semindex = -1;
+    ASSERT_EQ((ssize_t)sizeof(semindex), read(pipes[0], &semindex, sizeof(semindex)));
+    ASSERT_GE(semindex, 0);
+    ASSERT_LT(semindex, nbsem);
+    EXPECT_EQ(0, claimed[semindex]++);
+  }
+  close(pipes[0]);
+  for (int c = 0; c < nchild; ++c) {
+    int wstatus;
+    ASSERT_EQ(pids[c], waitchild(pids[c], &wstatus));
+    EXPECT_EQ(0, WEXITSTATUS(wstatus));
+  }
+
+  // - Index is stable for a process, and released on request
+  int semindex = ImageStreamIO_getsemwaitindex(&writer, 2);
+  ASSERT_GE(semindex, 0);
+  EXPECT_NE(2, semindex);
+  EXPECT_EQ(semindex, ImageStreamIO_getsemwaitindex(&writer, 5));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_releasesemwaitindex(&writer, semindex));
+  EXPECT_EQ(0, writer.semReadPID[semindex]);
+
+  // - Indices of dead readers are reclaimed once the lease expired ...
+  writer.semreader[2].lease = 0;
+  EXPECT_EQ(2, ImageStreamIO_getsemwaitindex(&writer, 2));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_releasesemwaitindex(&writer, 2));
+
+  // - ... but not those of live readers
+  for (int s = 0; s < nbsem; ++s) {
+    writer.semReadPID[s] = getppid();
+    writer.semreader[s].lease = 0;
+  }
+  EXPECT_EQ(-1, ImageStreamIO_getsemwaitindex(&writer, 2));
+  EXPECT_NE(IMAGESTREAMIO_SUCCESS, ImageStreamIO_releasesemwaitindex(&writer, 2));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestConsistentRead, NoTornFrames) {
+
+  IMAGE writer;
+  IMAGE reader;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_SeqTest
+                                      ,2, dims2, _DATATYPE_UINT32
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_SeqTest));
+
+  const uint64_t nframes = 20000;
+  const uint64_t nelement = reader.md->nelement;
+
+  // - Writer: every pixel of frame k is k
+  std::thread writerthread([&writer, nframes, nelement]() {
+    for (uint32_t k = 1; k <= nframes; ++k) {
+      ImageStreamIO_BeginUpdateIm(&writer);
+      for (uint64_t ii = 0; ii < nelement; ++ii) {
+        writer.array.UI32[ii] = k;
+      }
+      ImageStreamIO_UpdateIm(&writer);
+    }
+  });
+
+  // - Reader: every frame read is uniform and matches cnt0
+  std::vector<uint32_t> frame(nelement);
+  uint64_t cnt0 = 0;
+  uint64_t cnt0prev = 0;
+  int ntorn = 0;
+  while (cnt0 < nframes) {
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+             ,ImageStreamIO_read_consistent(&reader, frame.data(), &cnt0));
+    EXPECT_GE(cnt0, cnt0prev);
+    cnt0prev = cnt0;
+    for (uint64_t ii = 0; ii < nelement; ++ii) {
+      if (frame[ii] != cnt0) { ++ntorn; break; }
+    }
+  }
+  writerthread.join();
+  EXPECT_EQ(0, ntorn);
+  EXPECT_EQ(0, reader.md->write);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestLazySem, LazyAttach) {
+
+  IMAGE writer;
+  IMAGE reader;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_LazyTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 4, 0
+                                      ,MATH_DATA, 0)
+           );
+  ImageStreamIO_semflush(&writer, -1);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader, SHM_NAME_LazyTest
+                                      ,IMAGE_OPEN_LAZYSEM));
+
+  // - No semaphore opened at open time
+  ASSERT_NE((sem_t**)NULL, reader.semptr);
+  for (int s = 0; s < 4; ++s) {
+    EXPECT_EQ((sem_t*)NULL, reader.semptr[s]);
+  }
+  EXPECT_EQ((sem_t*)NULL, reader.semlog);
+
+  // - Semaphores attached by the calls using them, and shared with writer
+  int semindex = ImageStreamIO_getsemwaitindex(&reader, 2);
+  EXPECT_EQ(2, semindex);
+  EXPECT_NE((sem_t*)NULL, reader.semptr[2]);
+  EXPECT_EQ((sem_t*)NULL, reader.semptr[1]);
+
+  ImageStreamIO_sempost(&writer, 1);
+  EXPECT_EQ(0, ImageStreamIO_semtrywait(&reader, 1));
+  EXPECT_NE((sem_t*)NULL, reader.semptr[1]);
+  EXPECT_EQ(-1, ImageStreamIO_semtrywait(&reader, 1));
+
+  ImageStreamIO_sempost(&reader, 3);
+  EXPECT_NE((sem_t*)NULL, reader.semlog);
+  EXPECT_EQ(1, ImageStreamIO_semvalue(&writer, 3));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestRegistry, LookupAndList) {
+
+  IMAGE image;
+  IMAGE_REGISTRY_ENTRY entry;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&image, SHM_NAME_RegTest
+                                      ,2, dims2, _DATATYPE_INT16
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA, 0)
+           );
+
+  // - Created stream is registered
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_registry_lookup(SHM_NAME_RegTest, &entry));
+  EXPECT_STREQ(SHM_NAME_RegTest, entry.name);
+  EXPECT_EQ(image.md->inode, entry.inode);
+  EXPECT_EQ(image.memsize, entry.memsize);
+  EXPECT_EQ(_DATATYPE_INT16, entry.datatype);
+  EXPECT_EQ(getpid(), entry.creatorPID);
+  int64_t createcnt = entry.createcnt;
+
+  // - and listed
+  long nbstream = ImageStreamIO_registry_list(NULL, 0);
+  ASSERT_GT(nbstream, 0);
+  std::vector<IMAGE_REGISTRY_ENTRY> entries(nbstream);
+  ASSERT_EQ(nbstream, ImageStreamIO_registry_list(entries.data(), nbstream));
+  int nfound = 0;
+  for (auto& e : entries) {
+    if (strcmp(e.name, SHM_NAME_RegTest) == 0) { ++nfound; }
+  }
+  EXPECT_EQ(1, nfound);
+
+  // - Destroyed stream is not found anymore
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&image));
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE
+           ,ImageStreamIO_registry_lookup(SHM_NAME_RegTest, NULL));
+  EXPECT_EQ(nbstream - 1, ImageStreamIO_registry_list(NULL, 0));
+
+  // - Re-created stream increments createcnt
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&image, SHM_NAME_RegTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_registry_lookup(SHM_NAME_RegTest, &entry));
+  EXPECT_EQ(createcnt + 1, entry.createcnt);
+  EXPECT_EQ(_DATATYPE_FLOAT, entry.datatype);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&image));
+}
+
+TEST(ImageStreamIOTestHugePage, AlignedData) {
+
+  IMAGE writer;
+  IMAGE reader;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_HugeTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA | IMAGE_OPT_HUGEPAGE, 3)
+           );
+  uint64_t hugepagesize = writer.md->hugepagesize;
+  ASSERT_GT(hugepagesize, 0);
+
+  // - Data and circular buffer data on huge page boundaries
+  EXPECT_EQ(0, ((uint8_t*)writer.array.raw - (uint8_t*)writer.md) % hugepagesize);
+  EXPECT_EQ(0, ((uint8_t*)writer.CBimdata - (uint8_t*)writer.md) % hugepagesize);
+  EXPECT_EQ(0, writer.memsize % hugepagesize);
+
+  // - Reader maps the same layout
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_HugeTest));
+  EXPECT_EQ(hugepagesize, reader.md->hugepagesize);
+  EXPECT_EQ((uint8_t*)writer.array.raw - (uint8_t*)writer.md
+           ,(uint8_t*)reader.array.raw - (uint8_t*)reader.md);
+  EXPECT_EQ((uint8_t*)writer.CBimdata - (uint8_t*)writer.md
+           ,(uint8_t*)reader.CBimdata - (uint8_t*)reader.md);
+
+  ImageStreamIO_BeginUpdateIm(&writer);
+  for (uint64_t ii = 0; ii < writer.md->nelement; ++ii) {
+    writer.array.F[ii] = 0.5f * ii;
+  }
+  ImageStreamIO_UpdateIm(&writer);
+  EXPECT_EQ(0.5f * (writer.md->nelement - 1)
+           ,reader.array.F[reader.md->nelement - 1]);
+  EXPECT_EQ(0.5f, ((float*)reader.CBimdata)[reader.md->nelement * reader.md->CBindex + 1]);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestCacheLine, ArrayAlignment) {
+
+  IMAGE writer;
+  IMAGE reader;
+
+  // - Writer-hot metadata on its own line
+  EXPECT_EQ(0, offsetof(IMAGE_METADATA, cnt0) % IMAGE_CACHELINE_SIZE);
+  EXPECT_EQ(0, sizeof(IMAGE_METADATA) % IMAGE_CACHELINE_SIZE);
+  EXPECT_EQ(IMAGE_CACHELINE_SIZE, sizeof(SEMFUTEX));
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_LineTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 5, 3
+                                      ,CIRCULAR_BUFFER | ZAXIS_TEMPORAL | IMAGE_OPT_FUTEX, 2)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_LineTest));
+
+  // - Per-reader and writer-owned arrays each start on a cache line,
+  //   reader maps the same layout
+  uint8_t *wptr[] = { (uint8_t*)writer.kw, (uint8_t*)writer.semfile
+                    , (uint8_t*)writer.semReadPID, (uint8_t*)writer.semWritePID
+                    , (uint8_t*)writer.semctrl, (uint8_t*)writer.semstatus
+                    , (uint8_t*)writer.semfutex, (uint8_t*)writer.semreader
+                    , (uint8_t*)writer.streamproctrace, (uint8_t*)writer.atimearray
+                    , (uint8_t*)writer.writetimearray, (uint8_t*)writer.cntarray
+                    , (uint8_t*)writer.CircBuff_md, (uint8_t*)writer.CBimdata };
+  uint8_t *rptr[] = { (uint8_t*)reader.kw, (uint8_t*)reader.semfile
+                    , (uint8_t*)reader.semReadPID, (uint8_t*)reader.semWritePID
+                    , (uint8_t*)reader.semctrl, (uint8_t*)reader.semstatus
+                    , (uint8_t*)reader.semfutex, (uint8_t*)reader.semreader
+                    , (uint8_t*)reader.streamproctrace, (uint8_t*)reader.atimearray
+                    , (uint8_t*)reader.writetimearray, (uint8_t*)reader.cntarray
+                    , (uint8_t*)reader.CircBuff_md, (uint8_t*)reader.CBimdata };
+  for (size_t ii = 0; ii < sizeof(wptr) / sizeof(wptr[0]); ++ii) {
+    EXPECT_EQ(0, (wptr[ii] - (uint8_t*)writer.md) % IMAGE_CACHELINE_SIZE);
+    EXPECT_EQ(wptr[ii] - (uint8_t*)writer.md, rptr[ii] - (uint8_t*)reader.md);
+  }
+  // - Each reader slot on its own line
+  EXPECT_EQ(IMAGE_CACHELINE_SIZE, sizeof(SEMREADER));
+#ifdef IMAGESTRUCT_WRITEHISTORY
+  EXPECT_EQ((uint8_t*)writer.writehist - (uint8_t*)writer.md
+           ,(uint8_t*)reader.writehist - (uint8_t*)reader.md);
+#endif
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestZeroCopy, InPlaceCB) {
+
+  IMAGE writer;
+  IMAGE reader;
+  const uint32_t CBsize = 4;
+
+  // - Needs CBsize >= 2
+  EXPECT_EQ(IMAGESTREAMIO_INVALIDARG
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ZeroTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA | IMAGE_OPT_CBZEROCOPY, 1)
+           );
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ZeroTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA | IMAGE_OPT_CBZEROCOPY, CBsize)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_ZeroTest));
+
+  std::vector<float> frame(writer.md->nelement);
+
+  // - Nothing published yet: initial slot, frame 0
+  uint64_t cnt0init = 1;
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_read_consistent(&reader, frame.data(), &cnt0init));
+  EXPECT_EQ(0, cnt0init);
+
+  for (uint32_t ii = 1; ii <= 2 * CBsize + 1; ++ii) {
+    // - Writer fills a CB slot directly, never the latest frame
+    uint8_t *slot = (uint8_t*)writer.array.raw;
+    ASSERT_GE(slot, (uint8_t*)writer.CBimdata);
+    ASSERT_NE(slot, (uint8_t*)ImageStreamIO_get_latest_ptr(&writer));
+
+    ImageStreamIO_BeginUpdateIm(&writer);
+    for (uint64_t jj = 0; jj < writer.md->nelement; ++jj) {
+      writer.array.F[jj] = ii;
+    }
+    ImageStreamIO_UpdateIm(&writer);
+
+    // - Commit publishes that slot, readers resolve it without copy
+    EXPECT_EQ(ii % CBsize, reader.md->CBindex);
+    EXPECT_EQ(slot - (uint8_t*)writer.md
+             ,(uint8_t*)ImageStreamIO_get_latest_ptr(&reader) - (uint8_t*)reader.md);
+    EXPECT_EQ((float)ii, ((float*)ImageStreamIO_get_latest_ptr(&reader))[0]);
+
+    uint64_t cnt0 = 0;
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+             ,ImageStreamIO_read_consistent(&reader, frame.data(), &cnt0));
+    EXPECT_EQ(ii, cnt0);
+    EXPECT_EQ((float)ii, frame[writer.md->nelement - 1]);
+
+    void *ptr = NULL;
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_CB_get(&reader, ii, &ptr, NULL));
+    EXPECT_EQ(ImageStreamIO_get_latest_ptr(&reader), ptr);
+  }
+  EXPECT_EQ(2, writer.md->CBcycle);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestCBGet, FrameByCnt0) {
+
+  IMAGE writer;
+  IMAGE reader;
+  const uint32_t CBsize = 4;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_CBGetTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA, CBsize)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_CBGetTest));
+
+  // - Nothing published yet
+  void *ptr = NULL;
+  CBFRAMEMD framemd;
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_CB_get(&reader, 1, &ptr, &framemd));
+  EXPECT_EQ(EAGAIN, errno);
+
+  for (uint64_t ii = 1; ii <= 6; ++ii) {
+    ImageStreamIO_BeginUpdateIm(&writer);
+    writer.array.F[0] = ii;
+    writer.md->cnt1 = 10 * ii;
+    ImageStreamIO_UpdateIm(&writer);
+  }
+
+  // - Frames still in the buffer, stamped with their metadata
+  for (uint64_t ii = 3; ii <= 6; ++ii) {
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_CB_get(&reader, ii, &ptr, &framemd));
+    EXPECT_EQ(ii, framemd.cnt0);
+    EXPECT_EQ(10 * ii, framemd.cnt1);
+    EXPECT_EQ((float)ii, ((float*)ptr)[0]);
+    EXPECT_EQ(1, ImageStreamIO_CB_check(&reader, ii, ptr));
+  }
+
+  // - Overwritten and future frames
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_CB_get(&reader, 2, &ptr, NULL));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_CB_get(&reader, 7, &ptr, NULL));
+  EXPECT_EQ(EAGAIN, errno);
+
+  // - Held frame detected as overwritten once writer wraps around
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_CB_get(&reader, 3, &ptr, NULL));
+  ImageStreamIO_UpdateIm(&writer);
+  EXPECT_EQ(0, ImageStreamIO_CB_check(&reader, 3, ptr));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestCopy, AllPaths) {
+
+  const size_t n = 4096 + 77;
+  std::vector<uint8_t> src(n + 64);
+  for (size_t ii = 0; ii < src.size(); ++ii) {
+    src[ii] = (uint8_t)(ii * 7 + 3);
+  }
+
+  for (int path = IMAGE_COPY_AUTO; path <= IMAGE_COPY_AVX512_NT; ++path) {
+    errno_t ret = ImageStreamIO_copy_path(NULL, NULL, 0, path);
+    if (ret == IMAGESTREAMIO_NOTIMPL) { continue; }
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ret);
+
+    // - Unaligned source and destination, size not a multiple of vector width
+    for (size_t offset : {0, 1, 13, 33}) {
+      std::vector<uint8_t> dst(n + 64, 0);
+      ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+               ,ImageStreamIO_copy_path(dst.data() + offset, src.data() + 5, n, path));
+      EXPECT_EQ(0, memcmp(dst.data() + offset, src.data() + 5, n))
+        << ImageStreamIO_copy_pathname(path) << " offset " << offset;
+      EXPECT_EQ(0, dst[offset + n]);
+    }
+  }
+
+  EXPECT_EQ(IMAGESTREAMIO_NOTIMPL, ImageStreamIO_copy_path(NULL, NULL, 0, -1));
+}
+
+TEST(ImageStreamIOTestCopyPool, SplitCopy) {
+
+  IMAGE writer;
+  IMAGE reader;
+  uint32_t dims[2] = {512, 300};
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_PoolTest
+                                      ,2, dims, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA, 2)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_PoolTest));
+
+  EXPECT_EQ(IMAGESTREAMIO_INVALIDARG, ImageStreamIO_set_copythreads(&writer, -1, 0));
+
+  // - Split all copies of this stream in 3 parts (frame is not a multiple of 3 lines)
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_set_copythreads(&writer, 3, 4096));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_set_copythreads(&reader, 4, 4096));
+
+  std::vector<float> frame(writer.md->nelement);
+  for (int cnt = 1; cnt <= 5; ++cnt) {
+    ImageStreamIO_BeginUpdateIm(&writer);
+    for (uint64_t ii = 0; ii < writer.md->nelement; ++ii) {
+      writer.array.F[ii] = cnt * 1000.0f + ii;
+    }
+    ImageStreamIO_UpdateIm(&writer);
+
+    // - Circular buffer copy and reader copy are complete
+    void *ptr = NULL;
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_CB_get(&reader, cnt, &ptr, NULL));
+    EXPECT_EQ(0, memcmp(ptr, writer.array.raw, writer.md->imdatamemsize));
+
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+             ,ImageStreamIO_read_consistent(&reader, frame.data(), NULL));
+    EXPECT_EQ(0, memcmp(frame.data(), writer.array.raw, writer.md->imdatamemsize));
+
+    memset(frame.data(), 0, writer.md->imdatamemsize);
+    ImageStreamIO_copyframe_cached(&reader, frame.data(), writer.array.raw, writer.md->imdatamemsize);
+    EXPECT_EQ(0, memcmp(frame.data(), writer.array.raw, writer.md->imdatamemsize));
+  }
+
+  // - Forked child does not inherit the workers, its pooled copies complete
+  SigchldDefault sigchld;
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    alarm(5);
+    ImageStreamIO_copyframe(&reader, frame.data(), writer.array.raw, writer.md->imdatamemsize);
+    _exit(memcmp(frame.data(), writer.array.raw, writer.md->imdatamemsize) != 0);
+  }
+  int wstatus;
+  ASSERT_EQ(pid, waitchild(pid, &wstatus));
+  EXPECT_TRUE(WIFEXITED(wstatus));
+  EXPECT_EQ(0, WEXITSTATUS(wstatus));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestCursor, DrainAndOverrun) {
+
+  IMAGE writer;
+  IMAGE reader;
+  IMAGE_CURSOR cursor;
+  IMAGE_SLICERANGE range[2];
+  uint64_t nblost = 0;
+  uint32_t slice = 0;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_CursorTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,CIRCULAR_BUFFER | ZAXIS_TEMPORAL, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_CursorTest));
+  const uint32_t NBslice = dims3[2];
+
+  // Writer: one slice per cnt0 increment, cntarray set before cnt1
+  auto writeslices = [&](int n) {
+    for (int ii = 0; ii < n; ++ii) {
+      uint32_t wslice = (writer.md->cnt1 + 1) % NBslice;
+      writer.cntarray[wslice] = writer.md->cnt0 + 1;
+      writer.md->cnt1 = wslice;
+      ImageStreamIO_UpdateIm(&writer);
+    }
+  };
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_cursor_init(&cursor, &reader));
+  EXPECT_EQ(0, ImageStreamIO_cursor_drain(&cursor, range, &nblost));
+
+  // - Backlog smaller than buffer: one range, nothing lost
+  writeslices(5);
+  ASSERT_EQ(1, ImageStreamIO_cursor_drain(&cursor, range, &nblost));
+  EXPECT_EQ(1, range[0].slice);
+  EXPECT_EQ(5, range[0].nslice);
+  EXPECT_EQ(1, range[0].cnt0);
+  EXPECT_EQ(0, nblost);
+
+  // - One at a time
+  writeslices(2);
+  ASSERT_EQ(1, ImageStreamIO_cursor_next(&cursor, &slice, &nblost));
+  EXPECT_EQ(6, slice);
+  ASSERT_EQ(1, ImageStreamIO_cursor_next(&cursor, &slice, &nblost));
+  EXPECT_EQ(7, slice);
+  EXPECT_EQ(0, ImageStreamIO_cursor_next(&cursor, &slice, &nblost));
+  EXPECT_EQ(7, cursor.cnt0);
+
+  // - Overrun: oldest slices overwritten, rest returned in two ranges,
+  //   except the oldest slice, next to be overwritten
+  writeslices(NBslice + 6);
+  ASSERT_EQ(2, ImageStreamIO_cursor_drain(&cursor, range, &nblost));
+  EXPECT_EQ(7, nblost);
+  EXPECT_EQ(NBslice - 1, range[0].nslice + range[1].nslice);
+  EXPECT_EQ(0, range[1].slice);
+  EXPECT_EQ(range[0].cnt0 + range[0].nslice, range[1].cnt0);
+  EXPECT_EQ(7 + 7 + 1, range[0].cnt0);
+  for (int rr = 0; rr < 2; ++rr) {
+    for (uint32_t ii = 0; ii < range[rr].nslice; ++ii) {
+      EXPECT_EQ(range[rr].cnt0 + ii, reader.cntarray[range[rr].slice + ii]);
+      EXPECT_EQ(1, ImageStreamIO_cursor_check(&cursor, range[rr].slice + ii, range[rr].cnt0 + ii));
+    }
+  }
+  EXPECT_EQ(7, cursor.nblost);
+  EXPECT_EQ(writer.md->cnt0, cursor.cnt0);
+
+  // - Check fails once the writer may be overwriting the slice
+  writeslices(1);
+  EXPECT_EQ(0, ImageStreamIO_cursor_check(&cursor, range[0].slice, range[0].cnt0));
+  EXPECT_EQ(1, ImageStreamIO_cursor_check(&cursor, range[0].slice + 1, range[0].cnt0 + 1));
+  writeslices(1);
+  EXPECT_EQ(0, ImageStreamIO_cursor_check(&cursor, range[0].slice, range[0].cnt0));
+
+  // - Not a temporal circular buffer
+  IMAGE_CURSOR badcursor;
+  IMAGE plain;
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&plain, SHM_NAME_CursorTest "2"
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA, 0)
+           );
+  EXPECT_EQ(IMAGESTREAMIO_INVALIDARG, ImageStreamIO_cursor_init(&badcursor, &plain));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&plain));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestCommitSlice, SliceMetadata) {
+
+  IMAGE writer;
+  IMAGE reader;
+  IMAGE_CURSOR cursor;
+  uint32_t slice = 0;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_SliceTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,CIRCULAR_BUFFER | ZAXIS_TEMPORAL, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_SliceTest));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_cursor_init(&cursor, &reader));
+
+  for (int ii = 1; ii <= 20; ++ii) {
+    float *wslice = NULL;
+    ImageStreamIO_BeginUpdateIm(&writer);
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_writeBuffer(&writer, (void**)&wslice));
+    wslice[0] = ii;
+
+    struct timespec atime = {ii, 0};
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_commitSlice(&writer, &atime));
+
+    // - cnt0, cnt1 and slice arrays consistent for readers
+    EXPECT_EQ((uint64_t)ii, reader.md->cnt0);
+    EXPECT_EQ(ii % dims3[2], reader.md->cnt1);
+    EXPECT_EQ((uint64_t)ii, reader.cntarray[reader.md->cnt1]);
+    EXPECT_EQ(ii, reader.atimearray[reader.md->cnt1].tv_sec);
+    EXPECT_GT(reader.writetimearray[reader.md->cnt1].tv_sec, 0);
+    EXPECT_EQ(1, ImageStreamIO_semvalue(&reader, 0) > 0);
+
+    ASSERT_EQ(1, ImageStreamIO_cursor_next(&cursor, &slice, NULL));
+    void *rslice = NULL;
+    ImageStreamIO_readBufferAt(&reader, slice, &rslice);
+    EXPECT_EQ((float)ii, ((float*)rslice)[0]);
+  }
+
+  // - Slice being rewritten is no longer reported
+  ImageStreamIO_BeginUpdateIm(&writer);
+  EXPECT_EQ(0, reader.cntarray[(reader.md->cnt1 + 1) % dims3[2]]);
+  ImageStreamIO_commitSlice(&writer, NULL);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestTicket, MultiProducer) {
+
+  IMAGE writer;
+  IMAGE reader;
+  uint64_t ticket[2];
+  float *slice[2];
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_TicketTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,CIRCULAR_BUFFER | ZAXIS_TEMPORAL, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_TicketTest));
+  const uint32_t NBslice = dims3[2];
+
+  // - Out of order commit only published once preceding slice is committed
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_reserveSlice(&writer, &ticket[0], (void**)&slice[0]));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_reserveSlice(&writer, &ticket[1], (void**)&slice[1]));
+  EXPECT_EQ(ticket[0] + 1, ticket[1]);
+  EXPECT_NE(slice[0], slice[1]);
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_commitReservedSlice(&writer, ticket[1], NULL));
+  EXPECT_EQ(0, reader.md->cnt0);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_commitReservedSlice(&writer, ticket[0], NULL));
+  EXPECT_EQ(2, reader.md->cnt0);
+  EXPECT_EQ(2, reader.md->cnt1);
+
+  // - Parallel producers, readers see every frame in order
+  const int NBproducer = 4;
+  const int NBframe = 500;
+  uint64_t cnt0 = reader.md->cnt0;
+  const uint64_t total = cnt0 + NBproducer * NBframe;
+  std::vector<std::thread> producers;
+  for (int pp = 0; pp < NBproducer; ++pp) {
+    producers.emplace_back([&writer]() {
+      for (int ff = 0; ff < NBframe; ++ff) {
+        uint64_t t;
+        float *ptr;
+        ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_reserveSlice(&writer, &t, (void**)&ptr));
+        for (uint32_t ii = 0; ii < dims3[0] * dims3[1]; ++ii) {
+          ptr[ii] = t + 1;
+        }
+        ImageStreamIO_commitReservedSlice(&writer, t, NULL);
+      }
+    });
+  }
+
+  while (cnt0 < total) {
+    uint64_t newcnt0 = __atomic_load_n(&reader.md->cnt0, __ATOMIC_ACQUIRE);
+    ASSERT_GE(newcnt0, cnt0);
+    cnt0 = newcnt0;
+    std::this_thread::yield();
+  }
+  for (auto &th : producers) { th.join(); }
+
+  EXPECT_EQ(total, reader.md->cnt0);
+  EXPECT_EQ(total % NBslice, reader.md->cnt1);
+  for (uint32_t ss = 0; ss < NBslice; ++ss) {
+    float *ptr;
+    ImageStreamIO_readBufferAt(&reader, ss, (void**)&ptr);
+    EXPECT_EQ(reader.cntarray[ss], (uint64_t)ptr[0]);
+    EXPECT_GT(reader.cntarray[ss], total - NBslice);
+  }
+
+  // - Flow control counts reserved, not yet published, slices
+  int semindex = ImageStreamIO_getsemwaitindex(&reader, 0);
+  ASSERT_EQ(0, semindex);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_register(&reader, semindex, 1));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_consumed(&reader, semindex, total));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_set_flowpolicy(&writer, IMAGE_FLOW_DROP));
+  // up to NBslice - 1 slices reserved, latest published slice not handed out
+  std::vector<uint64_t> reserved(NBslice - 1);
+  for (uint32_t ss = 0; ss < NBslice - 1; ++ss) {
+    EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flowcontrol(&writer));
+    float *ptr;
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_reserveSlice(&writer, &reserved[ss], (void**)&ptr));
+    EXPECT_NE(reader.md->cnt1, (reserved[ss] + 1) % NBslice);
+  }
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_flowcontrol(&writer));
+  EXPECT_EQ(ENOBUFS, errno);
+  for (uint32_t ss = 0; ss < NBslice - 1; ++ss) {
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_commitReservedSlice(&writer, reserved[ss], NULL));
+  }
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_consumed(&reader, semindex, reader.md->cnt0));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flowcontrol(&writer));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_releasesemwaitindex(&reader, semindex));
+
+  // - Slice of a producer that died before commit is published zero-filled
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_set_flowpolicy(&writer, IMAGE_FLOW_OVERWRITE));
+  SigchldDefault sigchld;
+  const uint64_t cnt0dead = reader.md->cnt0;
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    uint64_t t;
+    float *ptr;
+    ImageStreamIO_reserveSlice(&writer, &t, (void**)&ptr);
+    ptr[0] = -1.0f;
+    _exit(0);
+  }
+  int wstatus;
+  ASSERT_EQ(pid, waitchild(pid, &wstatus));
+  for (uint32_t ss = 0; ss < NBslice - 1; ++ss) {
+    // last reservation waits for the dead producer's slice
+    uint64_t t;
+    float *ptr;
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_reserveSlice(&writer, &t, (void**)&ptr));
+    ptr[0] = t + 1;
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_commitReservedSlice(&writer, t, NULL));
+  }
+  EXPECT_EQ(cnt0dead + NBslice, reader.md->cnt0);
+  EXPECT_EQ(1, reader.md->slicelostcnt);
+  uint32_t deadslice = (cnt0dead + 1) % NBslice;
+  float *deadptr;
+  ImageStreamIO_readBufferAt(&reader, deadslice, (void**)&deadptr);
+  EXPECT_EQ(cnt0dead + 1, reader.cntarray[deadslice]);
+  EXPECT_EQ(0.0f, deadptr[0]);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestEvent, RingAppendRead) {
+
+  IMAGE writer;
+  IMAGE reader;
+  uint32_t ringsize[1] = { 100 };
+  EVENT_UI8_UI8_UI16_UI8 events[70];
+  EVENT_UI8_UI8_UI16_UI8 rdevents[100];
+  IMAGE_EVENTBATCH batch;
+  uint64_t since = 0;
+  uint64_t nblost;
+
+  ASSERT_EQ(sizeof(EVENT_UI8_UI8_UI16_UI8), SIZEOF_DATATYPE_EVENT_UI8_UI8_UI16_UI8);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_EventTest
+                                      ,1, ringsize, _DATATYPE_EVENT_UI8_UI8_UI16_UI8
+                                      ,-1, 1, 1, 0, MATH_DATA, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_EventTest));
+  ASSERT_NE(nullptr, reader.eventbatch);
+
+  for (int ii = 0; ii < 70; ++ii) {
+    events[ii].x = ii;
+    events[ii].y = 2 * ii;
+    events[ii].t = 1000 + ii;
+    events[ii].p = ii & 1;
+  }
+
+  // - Batches of different sizes
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_event_append(&writer, events, 30, NULL));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_event_append(&writer, events + 30, 5, NULL));
+  EXPECT_EQ(2, reader.md->cnt0);
+  EXPECT_EQ(35, reader.md->cnt2);
+  EXPECT_EQ(35, ImageStreamIO_event_read(&reader, &since, rdevents, 100, &nblost));
+  EXPECT_EQ(35, since);
+  EXPECT_EQ(0, nblost);
+  EXPECT_EQ(0, memcmp(events, rdevents, 35 * sizeof(EVENT_UI8_UI8_UI16_UI8)));
+  EXPECT_EQ(0, ImageStreamIO_event_read(&reader, &since, rdevents, 100, &nblost));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_event_batch(&reader, 2, &batch));
+  EXPECT_EQ(2, batch.cnt0);
+  EXPECT_EQ(30, batch.evstart);
+  EXPECT_EQ(5, batch.nevent);
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_event_batch(&reader, 3, &batch));
+  EXPECT_EQ(EAGAIN, errno);
+
+  // - Wraparound, reader behind by more than the ring loses oldest events
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_event_append(&writer, events, 70, NULL));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_event_append(&writer, events, 70, NULL));
+  EXPECT_EQ(175, reader.md->cnt2);
+  EXPECT_EQ(100, ImageStreamIO_event_read(&reader, &since, rdevents, 100, &nblost));
+  EXPECT_EQ(40, nblost);
+  EXPECT_EQ(175, since);
+  EXPECT_EQ(0, memcmp(events + 40, rdevents, 30 * sizeof(EVENT_UI8_UI8_UI16_UI8)));
+  EXPECT_EQ(0, memcmp(events, rdevents + 30, 70 * sizeof(EVENT_UI8_UI8_UI16_UI8)));
+
+  // - Batch larger than ring is rejected
+  EXPECT_EQ(IMAGESTREAMIO_INVALIDARG, ImageStreamIO_event_append(&writer, events, 101, NULL));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestFlow, Policies) {
+
+  IMAGE writer;
+  IMAGE reader;
+  const uint32_t CBsize = 4;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_FlowTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,-1, 1, 4, 0, MATH_DATA, CBsize)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_FlowTest));
+
+  int semindex = ImageStreamIO_getsemwaitindex(&reader, 1);
+  ASSERT_EQ(1, semindex);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_register(&reader, semindex, 1));
+  EXPECT_EQ(IMAGESTREAMIO_INVALIDARG, ImageStreamIO_set_flowpolicy(&writer, 7));
+
+  // - Overwrite: writer never held back
+  for (int ii = 0; ii < 6; ++ii) {
+    EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flowcontrol(&writer));
+    ImageStreamIO_UpdateIm(&writer);
+  }
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_consumed(&reader, semindex, 6));
+
+  // - Drop: writer runs CBsize frames ahead of required reader, then drops
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_set_flowpolicy(&writer, IMAGE_FLOW_DROP));
+  for (uint32_t ii = 0; ii < CBsize; ++ii) {
+    EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flowcontrol(&writer));
+    ImageStreamIO_UpdateIm(&writer);
+  }
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_flowcontrol(&writer));
+  EXPECT_EQ(ENOBUFS, errno);
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_flowcontrol(&writer));
+  EXPECT_EQ(2, reader.md->flowdropcnt);
+
+  // - Reader not required does not hold writer back
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_register(&reader, semindex, 0));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flowcontrol(&writer));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_register(&reader, semindex, 1));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_consumed(&reader, semindex, 6));
+
+  // - Block: writer waits for reader to consume
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_set_flowpolicy(&writer, IMAGE_FLOW_BLOCK));
+  uint64_t cnt0 = writer.md->cnt0;
+  std::thread consumer([&reader, semindex, cnt0]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ImageStreamIO_flow_consumed(&reader, semindex, cnt0);
+  });
+  auto t0 = std::chrono::steady_clock::now();
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flowcontrol(&writer));
+  EXPECT_GE(std::chrono::steady_clock::now() - t0, std::chrono::milliseconds(15));
+  consumer.join();
+  EXPECT_EQ(2, reader.md->flowdropcnt);
+
+  // - Released index no longer holds writer back
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_consumed(&reader, semindex, 0));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_releasesemwaitindex(&reader, semindex));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flowcontrol(&writer));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestCBDeferred, CopyAfterPublish) {
+
+  IMAGE writer;
+  IMAGE reader;
+  const uint32_t CBsize = 4;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_DeferTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 1, 0
+                                      ,MATH_DATA | IMAGE_OPT_CBDEFERRED, CBsize)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_DeferTest));
+
+  // - Frames end up in the buffer as without the option
+  void *ptr = NULL;
+  CBFRAMEMD framemd;
+  for (uint64_t ii = 1; ii <= 6; ++ii) {
+    ImageStreamIO_BeginUpdateIm(&writer);
+    writer.array.F[0] = ii;
+    writer.md->cnt1 = 10 * ii;
+    ImageStreamIO_UpdateIm(&writer);
+
+    EXPECT_EQ(ii, reader.md->cnt0);
+    EXPECT_EQ(ii % CBsize, reader.md->CBindex);
+    ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_CB_get(&reader, ii, &ptr, &framemd));
+    EXPECT_EQ(ii, framemd.cnt0);
+    EXPECT_EQ(10 * ii, framemd.cnt1);
+    EXPECT_EQ((float)ii, ((float*)ptr)[0]);
+  }
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_CB_get(&reader, 2, &ptr, NULL));
+  EXPECT_EQ(ENOENT, errno);
+
+  // - Reader woken by the post finds the new frame either not yet in the
+  //   buffer (EAGAIN) or complete and stamped, never a torn slot
+  const int NBframe = 200;
+  const uint64_t nelement = writer.md->nelement;
+  uint64_t acked = writer.md->cnt0;
+  int nbbad = 0;
+  ImageStreamIO_semflush(&reader, 0);
+  std::thread consumer([&]() {
+    for (int ff = 0; ff < NBframe; ++ff) {
+      ImageStreamIO_semwait(&reader, 0);
+      uint64_t cnt0 = __atomic_load_n(&reader.md->cnt0, __ATOMIC_ACQUIRE);
+      void *fptr = NULL;
+      CBFRAMEMD fmd;
+      if (ImageStreamIO_CB_get(&reader, cnt0, &fptr, &fmd) == IMAGESTREAMIO_SUCCESS) {
+        uint64_t nbwrong = 0;
+        for (uint64_t jj = 0; jj < nelement; ++jj) {
+          nbwrong += (((float*)fptr)[jj] != (float)cnt0);
+        }
+        if ((fmd.cnt0 != cnt0) || (nbwrong != 0) ||
+            !ImageStreamIO_CB_check(&reader, cnt0, fptr)) {
+          nbbad++;
+        }
+      } else if (errno != EAGAIN) {
+        nbbad++;
+      }
+      __atomic_store_n(&acked, cnt0, __ATOMIC_RELEASE);
+    }
+  });
+  for (int ff = 0; ff < NBframe; ++ff) {
+    ImageStreamIO_BeginUpdateIm(&writer);
+    for (uint64_t jj = 0; jj < nelement; ++jj) {
+      writer.array.F[jj] = writer.md->cnt0 + 1;
+    }
+    ImageStreamIO_UpdateIm(&writer);
+    // one frame at a time: the slot is not recycled while the reader looks at it
+    while (__atomic_load_n(&acked, __ATOMIC_ACQUIRE) < writer.md->cnt0) {
+      std::this_thread::yield();
+    }
+  }
+  consumer.join();
+  EXPECT_EQ(0, nbbad);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestReuse, InPlaceRecreate) {
+
+  IMAGE writer;
+  IMAGE rewriter;
+  IMAGE reader;
+  struct stat st0, st1;
+  char fname[STRINGMAXLEN_FILE_NAME];
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReuseTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 1
+                                      ,MATH_DATA | IMAGE_OPT_REUSE, 4)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm(&reader, SHM_NAME_ReuseTest));
+  EXPECT_EQ(0.0f, reader.array.F[5]);
+  int semindex = ImageStreamIO_getsemwaitindex(&reader, 1);
+  ASSERT_EQ(1, semindex);
+  for (int ii = 0; ii < 3; ++ii) {
+    ImageStreamIO_BeginUpdateIm(&writer);
+    writer.array.F[5] = 5.0f;
+    ImageStreamIO_UpdateIm(&writer);
+  }
+  EXPECT_EQ(3, reader.md->cnt0);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_consumed(&reader, semindex, 2));
+  EXPECT_EQ(3, ImageStreamIO_semvalue(&reader, semindex));
+  ImageStreamIO_filename(fname, sizeof(fname), SHM_NAME_ReuseTest);
+  ASSERT_EQ(0, stat(fname, &st0));
+
+  // - Compatible: same file and mapping, counters reset, data kept
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&rewriter, SHM_NAME_ReuseTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 1
+                                      ,MATH_DATA | IMAGE_OPT_REUSE, 4)
+           );
+  ASSERT_EQ(0, stat(fname, &st1));
+  EXPECT_EQ(st0.st_ino, st1.st_ino);
+  EXPECT_EQ(0, reader.md->cnt0);
+  EXPECT_EQ(0, reader.md->CBindex);
+  EXPECT_EQ(5.0f, reader.array.F[5]);
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_CB_get(&reader, 1, NULL, NULL));
+
+  // - Reader keeps its index, with nothing consumed and no pending post
+  EXPECT_EQ(getpid(), reader.semReadPID[semindex]);
+  EXPECT_EQ(0, reader.semreader[semindex].cnt0);
+  EXPECT_EQ(0, ImageStreamIO_semvalue(&reader, semindex));
+
+  ImageStreamIO_UpdateIm(&rewriter);
+  EXPECT_EQ(1, reader.md->cnt0);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_CB_get(&reader, 1, NULL, NULL));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&writer));
+
+  // - Incompatible geometry: created anew
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&rewriter));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReuseTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 1
+                                      ,MATH_DATA | IMAGE_OPT_REUSE, 4)
+           );
+  EXPECT_EQ(3, writer.md->naxis);
+  EXPECT_EQ(dims3[2], writer.md->size[2]);
+  EXPECT_EQ(0.0f, writer.array.F[5]);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestMemPrep, PopulatePretouch) {
+
+  IMAGE writer;
+  IMAGE reader;
+  const uint32_t prepared = IMAGE_MEMSTATUS_POPULATED | IMAGE_MEMSTATUS_PRETOUCHED;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_MemTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_POPULATE | IMAGE_OPT_PRETOUCH, 0)
+           );
+  EXPECT_EQ(prepared, writer.md->memstatus);
+  EXPECT_EQ(prepared, writer.memstatus);
+  EXPECT_EQ(0.0f, writer.array.F[7]);
+
+  // - Stream options apply on open, open flags add to them
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_openIm(&reader, SHM_NAME_MemTest));
+  EXPECT_EQ(prepared, reader.memstatus);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+
+  // - mlock may be refused by RLIMIT_MEMLOCK: open still succeeds
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader, SHM_NAME_MemTest, IMAGE_OPEN_MLOCK));
+  EXPECT_EQ(prepared, reader.memstatus & prepared);
+  ImageStreamIO_BeginUpdateIm(&writer);
+  writer.array.F[7] = 7.0f;
+  ImageStreamIO_UpdateIm(&writer);
+  EXPECT_EQ(7.0f, reader.array.F[7]);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestNuma, BindInterleave) {
+
+  IMAGE writer;
+  IMAGE reader;
+
+  // - Data and CB bound to node 0, present on any Linux host
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_NumaTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_NUMABIND | IMAGE_OPT_NUMACB
+                                       | IMAGE_OPT_NUMANODE(0) | IMAGE_OPT_PRETOUCH, 4)
+           );
+  EXPECT_EQ(IMAGE_NUMA_BIND, writer.md->numapolicy);
+  EXPECT_EQ(0, writer.md->numanode);
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_openIm(&reader, SHM_NAME_NumaTest));
+  EXPECT_EQ(0, reader.md->numanode);
+  ImageStreamIO_BeginUpdateIm(&writer);
+  writer.array.F[3] = 3.0f;
+  ImageStreamIO_UpdateIm(&writer);
+  EXPECT_EQ(3.0f, reader.array.F[3]);
+
+  cpu_set_t cpuset0, cpuset;
+  ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset0));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_numa_pin(&reader));
+  ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset));
+  EXPECT_GT(CPU_COUNT(&cpuset), 0);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset0);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+
+  // - Interleaved: no single node to pin to
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_NumaTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_NUMAINTERLEAVE, 0)
+           );
+  EXPECT_EQ(IMAGE_NUMA_INTERLEAVE, writer.md->numapolicy);
+  EXPECT_EQ(-1, writer.md->numanode);
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_numa_pin(&writer));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestOpenCache, SharedMapping) {
+
+  IMAGE writer;
+  IMAGE reader1;
+  IMAGE reader2;
+  IMAGE reader3;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_CacheTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+
+  // - Cached opens share one mapping, distinct from the writer's
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader1, SHM_NAME_CacheTest, IMAGE_OPEN_CACHED));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader2, SHM_NAME_CacheTest, IMAGE_OPEN_CACHED));
+  EXPECT_EQ(reader1.md, reader2.md);
+  EXPECT_EQ(reader1.array.raw, reader2.array.raw);
+  EXPECT_NE(writer.md, reader1.md);
+
+  // - Process-wide switch, plain openIm is cached too
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_set_opencache(1));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_openIm(&reader3, SHM_NAME_CacheTest));
+  EXPECT_EQ(reader1.md, reader3.md);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_set_opencache(0));
+
+  // - Mapping stays valid until last close
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader1));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader3));
+  ImageStreamIO_BeginUpdateIm(&writer);
+  writer.array.F[9] = 9.0f;
+  ImageStreamIO_UpdateIm(&writer);
+  EXPECT_EQ(9.0f, reader2.array.F[9]);
+  EXPECT_EQ(1, reader2.md->cnt0);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader2));
+
+  // - Re-created stream (new inode) gets a new mapping
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader1, SHM_NAME_CacheTest, IMAGE_OPEN_CACHED));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_CacheTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader2, SHM_NAME_CacheTest, IMAGE_OPEN_CACHED));
+  EXPECT_NE(reader1.md, reader2.md);
+  EXPECT_EQ(2, reader1.md->naxis);
+  EXPECT_EQ(3, reader2.md->naxis);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader1));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader2));
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+
+  // - Destroy through a cached handle removes its entry, so an uncached
+  //   handle mapped at the same address is unmapped by its own close
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_CacheTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader1, SHM_NAME_CacheTest, IMAGE_OPEN_CACHED));
+  void *cachedmd = reader1.md;
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&writer));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&reader1));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_CacheTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_openIm(&reader2, SHM_NAME_CacheTest));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader3, SHM_NAME_CacheTest, IMAGE_OPEN_CACHED));
+  EXPECT_NE(reader2.md, reader3.md);
+  bool reused = ((void*)reader2.md == cachedmd);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader2));
+  if (reused) {
+    EXPECT_EQ(-1, msync(cachedmd, 4096, MS_ASYNC));
+    EXPECT_EQ(ENOMEM, errno);
+  }
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader3));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+
+  // - Semaphores attached on first use by one handle are closed with it
+  auto nbsemmapped = []() {
+    FILE *maps = fopen("/proc/self/maps", "r");
+    char line[1024];
+    int nbmapped = 0;
+    while ((maps != NULL) && (fgets(line, sizeof(line), maps) != NULL)) {
+      nbmapped += (strstr(line, "/dev/shm/sem.") != NULL);
+    }
+    if (maps != NULL) { fclose(maps); }
+    return nbmapped;
+  };
+  int nbsem0 = nbsemmapped();
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_CacheTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader1, SHM_NAME_CacheTest
+                                      ,IMAGE_OPEN_CACHED | IMAGE_OPEN_LAZYSEM));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_openIm_flags(&reader2, SHM_NAME_CacheTest
+                                      ,IMAGE_OPEN_CACHED | IMAGE_OPEN_LAZYSEM));
+  ImageStreamIO_sempost(&reader2, -1);
+  EXPECT_EQ(NULL, reader1.semlog);
+  EXPECT_NE((sem_t*)NULL, reader2.semlog);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader2));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader1));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+  EXPECT_EQ(nbsem0, nbsemmapped());
+}
+
+TEST(ImageStreamIOTestReconnect, DestroyRecreate) {
+
+  IMAGE writer;
+  IMAGE reader;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReconnectTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  EXPECT_EQ(IMAGE_SEMAPHORE_CONTROL_READY, writer.semctrl[1]);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_openIm(&reader, SHM_NAME_ReconnectTest));
+  ASSERT_EQ(1, ImageStreamIO_getsemwaitindex(&reader, 1));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_flow_register(&reader, 1, 1));
+  EXPECT_EQ(IMAGESTREAMIO_FAILURE, ImageStreamIO_reconnect(&reader));
+  EXPECT_EQ(EAGAIN, errno);
+
+  // - Waiting reader released by destroy, remapped onto new stream
+  int rv = 0;
+  int err = 0;
+  std::thread waiter([&]() {
+    rv = ImageStreamIO_semwait(&reader, 1);
+    err = errno;
+  });
+  usleep(20000);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+  usleep(20000);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReconnectTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  waiter.join();
+  EXPECT_EQ(-1, rv);
+  EXPECT_EQ(ESTALE, err);
+  EXPECT_EQ(writer.md->inode, reader.md->inode);
+  EXPECT_EQ(3, reader.md->naxis);
+  EXPECT_EQ(getpid(), reader.semReadPID[1]);
+  EXPECT_TRUE(reader.semstatus[1] & IMAGE_SEMAPHORE_STATUS_FLOWREQUIRED);
+  EXPECT_EQ(0, reader.semreader[1].cnt0);
+
+  ImageStreamIO_BeginUpdateIm(&writer);
+  writer.array.F[11] = 11.0f;
+  ImageStreamIO_UpdateIm(&writer);
+  EXPECT_EQ(0, ImageStreamIO_semwait(&reader, 1));
+  EXPECT_EQ(11.0f, reader.array.F[11]);
+
+  // - Re-create over live stream: readers keep a valid mapping
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReconnectTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  EXPECT_EQ(11.0f, reader.array.F[11]);
+  EXPECT_EQ(-1, ImageStreamIO_semtrywait(&reader, 1));
+  EXPECT_EQ(ESTALE, errno);
+  EXPECT_EQ(2, reader.md->naxis);
+
+  // - Destroyed and not re-created: timed wait expires
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 20000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_nsec -= 1000000000;
+    ts.tv_sec++;
+  }
+  ImageStreamIO_semtrywait(&reader, 1); // teardown post
+  EXPECT_EQ(-1, ImageStreamIO_semtimedwait(&reader, 1, &ts));
+  EXPECT_EQ(ETIMEDOUT, errno);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+
+  // - Named semaphores: waiting reader released by re-create
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReconnectTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0, MATH_DATA, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_openIm(&reader, SHM_NAME_ReconnectTest));
+  ASSERT_EQ(0, ImageStreamIO_getsemwaitindex(&reader, 0));
+  std::thread namedwaiter([&]() {
+    rv = ImageStreamIO_semwait(&reader, 0);
+    err = errno;
+  });
+  usleep(20000);
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReconnectTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0, MATH_DATA, 0)
+           );
+  namedwaiter.join();
+  EXPECT_EQ(-1, rv);
+  EXPECT_EQ(ESTALE, err);
+  EXPECT_EQ(3, reader.md->naxis);
+  EXPECT_EQ(-1, ImageStreamIO_semtrywait(&reader, 0));
+  EXPECT_EQ(EAGAIN, errno);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
+TEST(ImageStreamIOTestReconnect, SpinAndAnyWait) {
+
+  IMAGE writer;
+  IMAGE reader;
+  int rv = 0;
+  int err = 0;
+
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReconnectTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_openIm(&reader, SHM_NAME_ReconnectTest));
+  ASSERT_EQ(0, ImageStreamIO_getsemwaitindex(&reader, 0));
+
+  // - Spinning reader: returns ESTALE, does not touch the old mapping
+  std::thread spinner([&]() {
+    rv = ImageStreamIO_semspinwait(&reader, 0, 200000000L, NULL, NULL);
+    err = errno;
+  });
+  usleep(20000);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReconnectTest
+                                      ,3, dims3, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  spinner.join();
+  EXPECT_EQ(-1, rv);
+  EXPECT_EQ(ESTALE, err);
+  EXPECT_EQ(3, reader.md->naxis);
+
+  // - Wait on any: remapped stream reported with fired = -1
+  IMAGE *images[1] = { &reader };
+  int semindex[1] = { 0 };
+  int fired[1] = { 0 };
+  std::thread anywaiter([&]() {
+    rv = ImageStreamIO_semwait_any(images, semindex, 1, NULL, fired);
+    err = errno;
+  });
+  usleep(20000);
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+  ASSERT_EQ(IMAGESTREAMIO_SUCCESS
+           ,ImageStreamIO_createIm_gpu(&writer, SHM_NAME_ReconnectTest
+                                      ,2, dims2, _DATATYPE_FLOAT
+                                      ,cpuLocn, 1, 2, 0
+                                      ,MATH_DATA | IMAGE_OPT_FUTEX, 0)
+           );
+  anywaiter.join();
+  EXPECT_EQ(-1, rv);
+  EXPECT_EQ(ESTALE, err);
+  EXPECT_EQ(-1, fired[0]);
+  EXPECT_EQ(2, reader.md->naxis);
+
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_closeIm(&reader));
+  EXPECT_EQ(IMAGESTREAMIO_SUCCESS, ImageStreamIO_destroyIm(&writer));
+}
+
 } // namespace